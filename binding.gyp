@@ -9,6 +9,11 @@
       'include_dirs': [ "<!@(node -p \"require('node-addon-api').include\")" ],
       'sources': [
         'src/binding.cc',
+        'src/demux.cc',
+        'src/opus_toc.cc',
+        'src/packet_batch.cc',
+        'src/page_scan.cc',
+        'src/slab.cc',
       ],
       'dependencies': [
         'deps/libogg/libogg.gyp:libogg',
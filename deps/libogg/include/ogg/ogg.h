@@ -47,6 +47,32 @@ typedef struct {
   long body_len;
 } ogg_page;
 
+/* ogg_crc_marks is the running CRC of the bytes copied into a framing
+   buffer, checkpointed every few hundred bytes so that page checksums
+   can be taken without reading the page body a second time. Internal
+   to the framing code. */
+
+typedef struct {
+  ogg_uint32_t *marks;    /* running CRC at each checkpoint */
+  long          storage;
+  long          count;
+  long          origin;   /* buffer offset of marks[0] */
+  long          fill;     /* buffer offset the running CRC has reached */
+  ogg_uint32_t  crc;      /* running CRC at fill */
+} ogg_crc_marks;
+
+/* ogg_stream_refs lists the packet bodies ogg_stream_packetin_ref()
+   left in the caller's memory, in submission order. */
+
+typedef struct {
+  ogg_iovec_t  *iov;
+  long          storage;
+  long          fill;
+  long          returned; /* entries paged out completely */
+  long          offset;   /* bytes of iov[returned] paged out */
+  ogg_int64_t   released; /* entries paged out since the stream was set up */
+} ogg_stream_refs;
+
 /* ogg_stream_state contains the current encode/decode state of a logical
    Ogg bitstream **********************************************************/
 
@@ -82,6 +108,14 @@ typedef struct {
                              layer) also knows about the gap */
   ogg_int64_t   granulepos;
 
+  ogg_crc_marks crc;      /* running CRC of body_data */
+
+  long    growth_cap;     /* see ogg_stream_growth() */
+  long    reallocs;       /* body and lacing reallocations so far */
+
+  ogg_stream_refs refs;   /* bodies held by reference */
+  int     end_page;       /* an empty eos page is due, see ogg_stream_end() */
+
 } ogg_stream_state;
 
 /* ogg_packet is used to encapsulate the data and metadata belonging
@@ -111,8 +145,25 @@ typedef struct {
   int unsynced;
   int headerbytes;
   int bodybytes;
+
+  ogg_crc_marks crc;      /* running CRC of data, see ogg_sync_write() */
+
+  int verify;             /* checksum policy, see ogg_sync_verify() */
+  int verify_interval;
+  int verify_count;       /* pages returned since the policy was set */
+
+  long growth_cap;        /* see ogg_sync_growth() */
+  long reallocs;          /* data reallocations so far */
+
+  unsigned char *ring;    /* double mapping data lives in, see
+                             ogg_sync_ring(); NULL for a plain buffer */
 } ogg_sync_state;
 
+/* page checksum verification policies for ogg_sync_verify() */
+#define OGG_VERIFY_ALWAYS  0
+#define OGG_VERIFY_SAMPLED 1
+#define OGG_VERIFY_NEVER   2
+
 /* Ogg BITSTREAM PRIMITIVES: bitstream ************************/
 
 extern void  oggpack_writeinit(oggpack_buffer *b);
@@ -162,6 +213,12 @@ extern int      ogg_stream_pageout(ogg_stream_state *os, ogg_page *og);
 extern int      ogg_stream_pageout_fill(ogg_stream_state *os, ogg_page *og, int nfill);
 extern int      ogg_stream_flush(ogg_stream_state *os, ogg_page *og);
 extern int      ogg_stream_flush_fill(ogg_stream_state *os, ogg_page *og, int nfill);
+extern int      ogg_stream_packetin_ref(ogg_stream_state *os, ogg_packet *op);
+extern int      ogg_stream_pageout_ref(ogg_stream_state *os, ogg_page *og, int flush);
+extern int      ogg_stream_pageout_ref_fill(ogg_stream_state *os, ogg_page *og, int flush,
+                                            int nfill);
+extern void     ogg_stream_gather(ogg_stream_state *os, ogg_page *og,
+                                  unsigned char *body);
 
 /* Ogg BITSTREAM PRIMITIVES: decoding **************************/
 
@@ -173,7 +230,13 @@ extern int      ogg_sync_check(ogg_sync_state *oy);
 
 extern char    *ogg_sync_buffer(ogg_sync_state *oy, long size);
 extern int      ogg_sync_wrote(ogg_sync_state *oy, long bytes);
+extern int      ogg_sync_write(ogg_sync_state *oy, const unsigned char *data,
+                               long bytes);
 extern long     ogg_sync_pageseek(ogg_sync_state *oy,ogg_page *og);
+extern int      ogg_sync_verify(ogg_sync_state *oy, int policy, int interval);
+extern int      ogg_sync_growth(ogg_sync_state *oy, long cap);
+extern int      ogg_sync_shrink(ogg_sync_state *oy);
+extern int      ogg_sync_ring(ogg_sync_state *oy, long size);
 extern int      ogg_sync_pageout(ogg_sync_state *oy, ogg_page *og);
 extern int      ogg_stream_pagein(ogg_stream_state *os, ogg_page *og);
 extern int      ogg_stream_packetout(ogg_stream_state *os,ogg_packet *op);
@@ -188,8 +251,13 @@ extern int      ogg_stream_reset_serialno(ogg_stream_state *os,int serialno);
 extern int      ogg_stream_destroy(ogg_stream_state *os);
 extern int      ogg_stream_check(ogg_stream_state *os);
 extern int      ogg_stream_eos(ogg_stream_state *os);
+extern int      ogg_stream_end(ogg_stream_state *os);
+extern int      ogg_stream_growth(ogg_stream_state *os, long cap);
+extern int      ogg_stream_shrink(ogg_stream_state *os);
 
 extern void     ogg_page_checksum_set(ogg_page *og);
+extern long     ogg_page_scan(const unsigned char *data, long bytes,
+                              ogg_page *og, int *crc_ok);
 
 extern int      ogg_page_version(const ogg_page *og);
 extern int      ogg_page_continued(const ogg_page *og);
@@ -22,8 +22,18 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <ogg/ogg.h>
 
+#ifdef __linux__
+# include <sys/mman.h>
+# include <sys/syscall.h>
+# include <unistd.h>
+# ifdef __NR_memfd_create
+#  define OGG_SYNC_RING
+# endif
+#endif
+
 /* A complete description of Ogg framing exists in docs/framing.html */
 
 int ogg_page_version(const ogg_page *og){
@@ -96,9 +106,10 @@ int ogg_page_packets(const ogg_page *og){
 }
 
 
-#if 0
+#ifdef _V_SELFTEST
 /* helper to initialize lookup for direct-table CRC (illustrative; we
-   use the static init below) */
+   use the static tables in crctable.h, the self test checks them
+   against this) */
 
 static ogg_uint32_t _ogg_crc_entry(unsigned long index){
   int           i;
@@ -117,71 +128,7 @@ static ogg_uint32_t _ogg_crc_entry(unsigned long index){
 }
 #endif
 
-static const ogg_uint32_t crc_lookup[256]={
-  0x00000000,0x04c11db7,0x09823b6e,0x0d4326d9,
-  0x130476dc,0x17c56b6b,0x1a864db2,0x1e475005,
-  0x2608edb8,0x22c9f00f,0x2f8ad6d6,0x2b4bcb61,
-  0x350c9b64,0x31cd86d3,0x3c8ea00a,0x384fbdbd,
-  0x4c11db70,0x48d0c6c7,0x4593e01e,0x4152fda9,
-  0x5f15adac,0x5bd4b01b,0x569796c2,0x52568b75,
-  0x6a1936c8,0x6ed82b7f,0x639b0da6,0x675a1011,
-  0x791d4014,0x7ddc5da3,0x709f7b7a,0x745e66cd,
-  0x9823b6e0,0x9ce2ab57,0x91a18d8e,0x95609039,
-  0x8b27c03c,0x8fe6dd8b,0x82a5fb52,0x8664e6e5,
-  0xbe2b5b58,0xbaea46ef,0xb7a96036,0xb3687d81,
-  0xad2f2d84,0xa9ee3033,0xa4ad16ea,0xa06c0b5d,
-  0xd4326d90,0xd0f37027,0xddb056fe,0xd9714b49,
-  0xc7361b4c,0xc3f706fb,0xceb42022,0xca753d95,
-  0xf23a8028,0xf6fb9d9f,0xfbb8bb46,0xff79a6f1,
-  0xe13ef6f4,0xe5ffeb43,0xe8bccd9a,0xec7dd02d,
-  0x34867077,0x30476dc0,0x3d044b19,0x39c556ae,
-  0x278206ab,0x23431b1c,0x2e003dc5,0x2ac12072,
-  0x128e9dcf,0x164f8078,0x1b0ca6a1,0x1fcdbb16,
-  0x018aeb13,0x054bf6a4,0x0808d07d,0x0cc9cdca,
-  0x7897ab07,0x7c56b6b0,0x71159069,0x75d48dde,
-  0x6b93dddb,0x6f52c06c,0x6211e6b5,0x66d0fb02,
-  0x5e9f46bf,0x5a5e5b08,0x571d7dd1,0x53dc6066,
-  0x4d9b3063,0x495a2dd4,0x44190b0d,0x40d816ba,
-  0xaca5c697,0xa864db20,0xa527fdf9,0xa1e6e04e,
-  0xbfa1b04b,0xbb60adfc,0xb6238b25,0xb2e29692,
-  0x8aad2b2f,0x8e6c3698,0x832f1041,0x87ee0df6,
-  0x99a95df3,0x9d684044,0x902b669d,0x94ea7b2a,
-  0xe0b41de7,0xe4750050,0xe9362689,0xedf73b3e,
-  0xf3b06b3b,0xf771768c,0xfa325055,0xfef34de2,
-  0xc6bcf05f,0xc27dede8,0xcf3ecb31,0xcbffd686,
-  0xd5b88683,0xd1799b34,0xdc3abded,0xd8fba05a,
-  0x690ce0ee,0x6dcdfd59,0x608edb80,0x644fc637,
-  0x7a089632,0x7ec98b85,0x738aad5c,0x774bb0eb,
-  0x4f040d56,0x4bc510e1,0x46863638,0x42472b8f,
-  0x5c007b8a,0x58c1663d,0x558240e4,0x51435d53,
-  0x251d3b9e,0x21dc2629,0x2c9f00f0,0x285e1d47,
-  0x36194d42,0x32d850f5,0x3f9b762c,0x3b5a6b9b,
-  0x0315d626,0x07d4cb91,0x0a97ed48,0x0e56f0ff,
-  0x1011a0fa,0x14d0bd4d,0x19939b94,0x1d528623,
-  0xf12f560e,0xf5ee4bb9,0xf8ad6d60,0xfc6c70d7,
-  0xe22b20d2,0xe6ea3d65,0xeba91bbc,0xef68060b,
-  0xd727bbb6,0xd3e6a601,0xdea580d8,0xda649d6f,
-  0xc423cd6a,0xc0e2d0dd,0xcda1f604,0xc960ebb3,
-  0xbd3e8d7e,0xb9ff90c9,0xb4bcb610,0xb07daba7,
-  0xae3afba2,0xaafbe615,0xa7b8c0cc,0xa379dd7b,
-  0x9b3660c6,0x9ff77d71,0x92b45ba8,0x9675461f,
-  0x8832161a,0x8cf30bad,0x81b02d74,0x857130c3,
-  0x5d8a9099,0x594b8d2e,0x5408abf7,0x50c9b640,
-  0x4e8ee645,0x4a4ffbf2,0x470cdd2b,0x43cdc09c,
-  0x7b827d21,0x7f436096,0x7200464f,0x76c15bf8,
-  0x68860bfd,0x6c47164a,0x61043093,0x65c52d24,
-  0x119b4be9,0x155a565e,0x18197087,0x1cd86d30,
-  0x029f3d35,0x065e2082,0x0b1d065b,0x0fdc1bec,
-  0x3793a651,0x3352bbe6,0x3e119d3f,0x3ad08088,
-  0x2497d08d,0x2056cd3a,0x2d15ebe3,0x29d4f654,
-  0xc5a92679,0xc1683bce,0xcc2b1d17,0xc8ea00a0,
-  0xd6ad50a5,0xd26c4d12,0xdf2f6bcb,0xdbee767c,
-  0xe3a1cbc1,0xe760d676,0xea23f0af,0xeee2ed18,
-  0xf0a5bd1d,0xf464a0aa,0xf9278673,0xfde69bc4,
-  0x89b8fd09,0x8d79e0be,0x803ac667,0x84fbdbd0,
-  0x9abc8bd5,0x9e7d9662,0x933eb0bb,0x97ffad0c,
-  0xafb010b1,0xab710d06,0xa6322bdf,0xa2f33668,
-  0xbcb4666d,0xb8757bda,0xb5365d03,0xb1f740b4};
+#include "crctable.h"
 
 /* init the encode/decode logical stream state */
 
@@ -219,6 +166,8 @@ int ogg_stream_clear(ogg_stream_state *os){
     if(os->body_data)_ogg_free(os->body_data);
     if(os->lacing_vals)_ogg_free(os->lacing_vals);
     if(os->granule_vals)_ogg_free(os->granule_vals);
+    if(os->crc.marks)_ogg_free(os->crc.marks);
+    if(os->refs.iov)_ogg_free(os->refs.iov);
 
     memset(os,0,sizeof(*os));
   }
@@ -233,54 +182,414 @@ int ogg_stream_destroy(ogg_stream_state *os){
   return(0);
 }
 
+/* Storage growth for the framing buffers: room for `needed'
+   elements plus as many again as are already allocated (at least
+   `minimum'), so a buffer filled piecemeal is reallocated
+   O(log n) times rather than O(n). A nonzero `cap' bounds that
+   headroom, for callers that would rather realloc more often than
+   overallocate huge buffers. Returns -1 if `needed' exceeds `max'. */
+
+static long _os_grow(long storage,long needed,long minimum,long cap,
+                     long max){
+  long extra=storage>minimum?storage:minimum;
+  if(cap>0 && extra>cap)extra=cap;
+  if(needed>max)return -1;
+  if(extra>max-needed)extra=max-needed;
+  return needed+extra;
+}
+
 /* Helpers for ogg_stream_encode; this keeps the structure and
    what's happening fairly clear */
 
-static int _os_body_expand(ogg_stream_state *os,int needed){
-  if(os->body_storage<=os->body_fill+needed){
+static int _os_body_expand(ogg_stream_state *os,long needed){
+  if(os->body_storage-needed<=os->body_fill){
     void *ret;
-    ret=_ogg_realloc(os->body_data,(os->body_storage+needed+1024)*
-                     sizeof(*os->body_data));
+    long storage=_os_grow(os->body_storage,os->body_fill+needed+1,
+                          1024,os->growth_cap,LONG_MAX);
+    if(storage<0){
+      ogg_stream_clear(os);
+      return -1;
+    }
+    ret=_ogg_realloc(os->body_data,storage*sizeof(*os->body_data));
     if(!ret){
       ogg_stream_clear(os);
       return -1;
     }
-    os->body_storage+=(needed+1024);
+    os->body_storage=storage;
     os->body_data=ret;
+    os->reallocs++;
   }
   return 0;
 }
 
-static int _os_lacing_expand(ogg_stream_state *os,int needed){
-  if(os->lacing_storage<=os->lacing_fill+needed){
+static int _os_lacing_expand(ogg_stream_state *os,long needed){
+  if(os->lacing_storage-needed<=os->lacing_fill){
     void *ret;
-    ret=_ogg_realloc(os->lacing_vals,(os->lacing_storage+needed+32)*
-                     sizeof(*os->lacing_vals));
+    long storage=_os_grow(os->lacing_storage,os->lacing_fill+needed+1,
+                          32,os->growth_cap,
+                          LONG_MAX/sizeof(*os->granule_vals));
+    if(storage<0){
+      ogg_stream_clear(os);
+      return -1;
+    }
+    ret=_ogg_realloc(os->lacing_vals,storage*sizeof(*os->lacing_vals));
     if(!ret){
       ogg_stream_clear(os);
       return -1;
     }
     os->lacing_vals=ret;
-    ret=_ogg_realloc(os->granule_vals,(os->lacing_storage+needed+32)*
-                     sizeof(*os->granule_vals));
+    ret=_ogg_realloc(os->granule_vals,storage*sizeof(*os->granule_vals));
     if(!ret){
       ogg_stream_clear(os);
       return -1;
     }
     os->granule_vals=ret;
-    os->lacing_storage+=(needed+32);
+    os->lacing_storage=storage;
+    os->reallocs++;
+  }
+  return 0;
+}
+
+/* Slicing-by-8 CRC: folds eight bytes per step through the eight
+   tables in crctable.h, then finishes byte by byte */
+
+static ogg_uint32_t _os_update_crc_sliced(ogg_uint32_t crc,
+                                          const unsigned char *buffer,
+                                          long size){
+  while(size>=8){
+    crc^=((ogg_uint32_t)buffer[0]<<24)|((ogg_uint32_t)buffer[1]<<16)|
+      ((ogg_uint32_t)buffer[2]<<8)|((ogg_uint32_t)buffer[3]);
+
+    crc=crc_lookup[7][ crc>>24      ]^crc_lookup[6][(crc>>16)&0xff]^
+        crc_lookup[5][(crc>> 8)&0xff]^crc_lookup[4][ crc     &0xff]^
+        crc_lookup[3][buffer[4]     ]^crc_lookup[2][buffer[5]     ]^
+        crc_lookup[1][buffer[6]     ]^crc_lookup[0][buffer[7]     ];
+
+    buffer+=8;
+    size-=8;
+  }
+
+  while(size--)
+    crc=(crc<<8)^crc_lookup[0][((crc >> 24)&0xff)^*buffer++];
+  return crc;
+}
+
+/* Carry-less multiply CRC folding (PCLMULQDQ on x86-64, PMULL on
+   AArch64), picked at runtime when the CPU has it.
+
+   The data is loaded 16 bytes at a time in big-endian order, so that bit
+   i of the 128-bit value is the coefficient of x^i. A 128-bit remainder
+   A=H*x^64+L is moved n bits further along the message with two 64x32
+   multiplies, A*x^n == H*(x^(n+64) mod P) + L*(x^n mod P), and the
+   result is XORed into the data n bits later. Four such remainders are
+   folded 64 bytes at a time, merged into one, and the last 16 byte
+   remainder plus any tail are finished with the tables. An incoming CRC
+   is XORed into the first four bytes, which is what the table loop
+   does implicitly.
+
+   The constants are x^n mod P for P=0x104c11db7; test_crc() checks the
+   folded CRC against the bytewise one. */
+
+#define CRC_FOLD_MIN 64
+
+#if (defined(__GNUC__) || defined(__clang__)) && \
+  (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CRC_FOLD_X86 1
+
+__attribute__((target("pclmul,ssse3")))
+static __m128i _crc_load_x86(const unsigned char *p){
+  const __m128i swap=_mm_set_epi8(0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15);
+  return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)p),swap);
+}
+
+/* a*x^n mod-P-congruent, k holds x^n mod P high, x^(n+64) mod P low */
+__attribute__((target("pclmul,ssse3")))
+static __m128i _crc_fold_x86(__m128i a,__m128i k){
+  return _mm_xor_si128(_mm_clmulepi64_si128(a,k,0x01),
+                       _mm_clmulepi64_si128(a,k,0x10));
+}
+
+__attribute__((target("pclmul,ssse3")))
+static ogg_uint32_t _os_update_crc_folded(ogg_uint32_t crc,
+                                          const unsigned char *buffer,
+                                          long size){
+  const __m128i swap=_mm_set_epi8(0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15);
+  const __m128i k512=_mm_set_epi64x(0xe6228b11,0x8833794c);
+  const __m128i k128=_mm_set_epi64x(0xe8a45605,0xc5b9cd4c);
+  unsigned char rem[16];
+  __m128i a0,a1,a2,a3;
+
+  a0=_mm_xor_si128(_crc_load_x86(buffer),_mm_set_epi32((int)crc,0,0,0));
+  a1=_crc_load_x86(buffer+16);
+  a2=_crc_load_x86(buffer+32);
+  a3=_crc_load_x86(buffer+48);
+  buffer+=64;
+  size-=64;
+
+  while(size>=64){
+    a0=_mm_xor_si128(_crc_fold_x86(a0,k512),_crc_load_x86(buffer));
+    a1=_mm_xor_si128(_crc_fold_x86(a1,k512),_crc_load_x86(buffer+16));
+    a2=_mm_xor_si128(_crc_fold_x86(a2,k512),_crc_load_x86(buffer+32));
+    a3=_mm_xor_si128(_crc_fold_x86(a3,k512),_crc_load_x86(buffer+48));
+    buffer+=64;
+    size-=64;
+  }
+
+  a1=_mm_xor_si128(_crc_fold_x86(a0,k128),a1);
+  a2=_mm_xor_si128(_crc_fold_x86(a1,k128),a2);
+  a3=_mm_xor_si128(_crc_fold_x86(a2,k128),a3);
+  while(size>=16){
+    a3=_mm_xor_si128(_crc_fold_x86(a3,k128),_crc_load_x86(buffer));
+    buffer+=16;
+    size-=16;
+  }
+
+  _mm_storeu_si128((__m128i *)rem,_mm_shuffle_epi8(a3,swap));
+  crc=_os_update_crc_sliced(0,rem,16);
+  return _os_update_crc_sliced(crc,buffer,size);
+}
+
+static int _crc_fold_supported(void){
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3");
+}
+
+#elif (defined(__GNUC__) || defined(__clang__)) && defined(__aarch64__)
+#include <arm_neon.h>
+#if defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#define CRC_FOLD_ARM 1
+#if defined(__clang__)
+#define CRC_FOLD_TARGET __attribute__((target("aes")))
+#else
+#define CRC_FOLD_TARGET __attribute__((target("+crypto")))
+#endif
+
+/* lane 1 is the high half, x^127 being the top bit of the first byte */
+CRC_FOLD_TARGET
+static uint64x2_t _crc_load_arm(const unsigned char *p){
+  uint64x2_t v=vreinterpretq_u64_u8(vrev64q_u8(vld1q_u8(p)));
+  return vextq_u64(v,v,1);
+}
+
+CRC_FOLD_TARGET
+static uint64x2_t _crc_fold_arm(uint64x2_t a,poly64_t khi,poly64_t klo){
+  poly128_t h=vmull_p64((poly64_t)vgetq_lane_u64(a,1),khi);
+  poly128_t l=vmull_p64((poly64_t)vgetq_lane_u64(a,0),klo);
+  return veorq_u64(vreinterpretq_u64_p128(h),vreinterpretq_u64_p128(l));
+}
+
+CRC_FOLD_TARGET
+static ogg_uint32_t _os_update_crc_folded(ogg_uint32_t crc,
+                                          const unsigned char *buffer,
+                                          long size){
+  const poly64_t k576=0x8833794c,k512=0xe6228b11;
+  const poly64_t k192=0xc5b9cd4c,k128=0xe8a45605;
+  unsigned char rem[16];
+  uint64x2_t a0,a1,a2,a3;
+
+  a0=veorq_u64(_crc_load_arm(buffer),
+               vcombine_u64(vcreate_u64(0),vcreate_u64((uint64_t)crc<<32)));
+  a1=_crc_load_arm(buffer+16);
+  a2=_crc_load_arm(buffer+32);
+  a3=_crc_load_arm(buffer+48);
+  buffer+=64;
+  size-=64;
+
+  while(size>=64){
+    a0=veorq_u64(_crc_fold_arm(a0,k576,k512),_crc_load_arm(buffer));
+    a1=veorq_u64(_crc_fold_arm(a1,k576,k512),_crc_load_arm(buffer+16));
+    a2=veorq_u64(_crc_fold_arm(a2,k576,k512),_crc_load_arm(buffer+32));
+    a3=veorq_u64(_crc_fold_arm(a3,k576,k512),_crc_load_arm(buffer+48));
+    buffer+=64;
+    size-=64;
   }
+
+  a1=veorq_u64(_crc_fold_arm(a0,k192,k128),a1);
+  a2=veorq_u64(_crc_fold_arm(a1,k192,k128),a2);
+  a3=veorq_u64(_crc_fold_arm(a2,k192,k128),a3);
+  while(size>=16){
+    a3=veorq_u64(_crc_fold_arm(a3,k192,k128),_crc_load_arm(buffer));
+    buffer+=16;
+    size-=16;
+  }
+
+  a3=vextq_u64(a3,a3,1);
+  vst1q_u8(rem,vrev64q_u8(vreinterpretq_u8_u64(a3)));
+  crc=_os_update_crc_sliced(0,rem,16);
+  return _os_update_crc_sliced(crc,buffer,size);
+}
+
+static int _crc_fold_supported(void){
+#if defined(__APPLE__)
+  return 1;
+#elif defined(__linux__) && defined(HWCAP_PMULL)
+  return (getauxval(AT_HWCAP)&HWCAP_PMULL)!=0;
+#else
   return 0;
+#endif
+}
+#endif
+
+#if defined(CRC_FOLD_X86) || defined(CRC_FOLD_ARM)
+/* probed when the library is loaded, so that threads calling in later only
+   ever read it */
+static int crc_fold;
+
+__attribute__((constructor))
+static void _crc_fold_init(void){
+  crc_fold=_crc_fold_supported();
+}
+#endif
+
+static ogg_uint32_t _os_update_crc(ogg_uint32_t crc,
+                                   const unsigned char *buffer,long size){
+#if defined(CRC_FOLD_X86) || defined(CRC_FOLD_ARM)
+  if(size>=CRC_FOLD_MIN){
+    if(crc_fold)return _os_update_crc_folded(crc,buffer,size);
+  }
+#endif
+  return _os_update_crc_sliced(crc,buffer,size);
+}
+
+/* a*b mod P, for CRCs as polynomials of degree below 32 */
+static ogg_uint32_t _os_crc_multiply(ogg_uint32_t a,ogg_uint32_t b){
+  ogg_uint32_t r=0;
+  int i;
+  for(i=31;i>=0;i--){
+    r=(r<<1)^(0x04c11db7&(0U-(r>>31)));
+    r^=a&(0U-((b>>i)&1));
+  }
+  return r;
+}
+
+/* Running CRC checkpoints (ogg_crc_marks).
+
+   Bytes copied into a framing buffer with _crc_marks_copy() are
+   checksummed block by block while they are still in cache, and the
+   running CRC is recorded every CRC_MARK_BYTES bytes. Since the CRC is
+   linear, the CRC of the bytes between two checkpoints A and B is
+   R(B) ^ R(A)*x^(8*(B-A)), so _crc_marks_update() only reads the
+   partial blocks at either end of a page again. Copying anywhere but
+   the current fill mark starts a new chain. */
+
+/* the buffer was compacted, moving every byte down by `bytes' */
+static void _crc_marks_shift(ogg_crc_marks *m,long bytes){
+  long drop;
+  if(!m->count)return;
+  m->origin-=bytes;
+  m->fill-=bytes;
+  if(m->fill<0){
+    m->count=0;
+    return;
+  }
+
+  /* keep the last checkpoint even if it was moved out, the next one
+     is computed from it */
+  drop=m->origin<0?(-m->origin+CRC_MARK_BYTES-1)/CRC_MARK_BYTES:0;
+  if(drop>m->count-1)drop=m->count-1;
+  if(drop){
+    m->count-=drop;
+    memmove(m->marks,m->marks+drop,m->count*sizeof(*m->marks));
+    m->origin+=drop*CRC_MARK_BYTES;
+  }
+}
+
+static int _crc_marks_add(ogg_crc_marks *m,ogg_uint32_t crc){
+  if(m->count>=m->storage){
+    long storage=m->storage*2+16;
+    void *ret=_ogg_realloc(m->marks,storage*sizeof(*m->marks));
+    if(!ret){
+      m->count=0;
+      return -1;
+    }
+    m->marks=ret;
+    m->storage=storage;
+  }
+  m->marks[m->count++]=crc;
+  return 0;
+}
+
+/* memcpy(base+pos,src,bytes), extending the running CRC */
+static void _crc_marks_copy(ogg_crc_marks *m,unsigned char *base,long pos,
+                            const unsigned char *src,long bytes){
+  if(!m->count || m->fill!=pos){
+    m->count=0;
+    m->origin=m->fill=pos;
+    m->crc=0;
+    if(_crc_marks_add(m,0)){
+      memcpy(base+pos,src,bytes);
+      return;
+    }
+  }
+
+  while(bytes>0){
+    long next=m->origin+m->count*CRC_MARK_BYTES;
+    long n=next-m->fill<bytes?next-m->fill:bytes;
+    memcpy(base+m->fill,src,n);
+    m->crc=_os_update_crc(m->crc,base+m->fill,n);
+    m->fill+=n;
+    src+=n;
+    bytes-=n;
+    if(m->fill==next && _crc_marks_add(m,m->crc)){
+      memcpy(base+next,src,bytes);
+      return;
+    }
+  }
+}
+
+/* extends crc over base[start,end), using checkpoints where they
+   cover the range */
+static ogg_uint32_t _crc_marks_update(ogg_crc_marks *m,ogg_uint32_t crc,
+                                      const unsigned char *base,
+                                      long start,long end){
+  if(m->count && end>m->origin){
+    long a=start>m->origin?
+      (start-m->origin+CRC_MARK_BYTES-1)/CRC_MARK_BYTES:0;
+    long b=(end-m->origin)/CRC_MARK_BYTES;
+    if(b>m->count-1)b=m->count-1;
+    if(b>a && b-a<CRC_MARK_SHIFTS){
+      long from=m->origin+a*CRC_MARK_BYTES;
+      long to=m->origin+b*CRC_MARK_BYTES;
+      crc=_os_update_crc(crc,base+start,from-start);
+      crc=_os_crc_multiply(crc^m->marks[a],crc_mark_shift[b-a])^m->marks[b];
+      return _os_update_crc(crc,base+to,end-to);
+    }
+  }
+  return _os_update_crc(crc,base+start,end-start);
+}
+
+/* CRC of a page header, taking its checksum field as zero */
+static ogg_uint32_t _os_header_crc(const unsigned char *header,long len){
+  static const unsigned char zeros[4]={0,0,0,0};
+  ogg_uint32_t crc_reg=_os_update_crc(0,header,22);
+  crc_reg=_os_update_crc(crc_reg,zeros,4);
+  return _os_update_crc(crc_reg,header+26,len-26);
+}
+
+static ogg_uint32_t _os_get_crc(const unsigned char *header){
+  return header[22]|(header[23]<<8)|(header[24]<<16)|
+    ((ogg_uint32_t)header[25]<<24);
+}
+
+static void _os_set_crc(unsigned char *header,ogg_uint32_t crc_reg){
+  header[22]=(unsigned char)(crc_reg&0xff);
+  header[23]=(unsigned char)((crc_reg>>8)&0xff);
+  header[24]=(unsigned char)((crc_reg>>16)&0xff);
+  header[25]=(unsigned char)((crc_reg>>24)&0xff);
 }
 
 /* checksum the page */
-/* Direct table CRC; note that this will be faster in the future if we
-   perform the checksum simultaneously with other copies */
+/* Table CRC. Pages built by the framing code are checksummed from the
+   running CRC taken while their bodies were copied in, see
+   ogg_crc_marks above. */
 
 void ogg_page_checksum_set(ogg_page *og){
   if(og){
     ogg_uint32_t crc_reg=0;
-    int i;
 
     /* safety; needed for API behavior, but not framing code */
     og->header[22]=0;
@@ -288,18 +597,74 @@ void ogg_page_checksum_set(ogg_page *og){
     og->header[24]=0;
     og->header[25]=0;
 
-    for(i=0;i<og->header_len;i++)
-      crc_reg=(crc_reg<<8)^crc_lookup[((crc_reg >> 24)&0xff)^og->header[i]];
-    for(i=0;i<og->body_len;i++)
-      crc_reg=(crc_reg<<8)^crc_lookup[((crc_reg >> 24)&0xff)^og->body[i]];
+    crc_reg=_os_update_crc(crc_reg,og->header,og->header_len);
+    crc_reg=_os_update_crc(crc_reg,og->body,og->body_len);
+
+    _os_set_crc(og->header,crc_reg);
+  }
+}
+
+/* Clean up 'returned data': drops what has been handed out already
+   (as pages while encoding, as packets while decoding) from the front
+   of the body and segment buffers. That means moving everything still
+   buffered down, so it is put off until at least as much has been
+   returned as is left, or until the room is needed for `body' more
+   bytes or `lacing' more segments. Either way, every byte and segment
+   is moved a bounded number of times on average, rather than once per
+   page or packet. */
+static void _os_compact(ogg_stream_state *os,long body,long lacing){
+  long lr=os->lacing_returned;
+  long br=os->body_returned;
+
+  /* body data */
+  if(br && (br>=os->body_fill-br || os->body_storage-body<=os->body_fill)){
+    os->body_fill-=br;
+    if(os->body_fill)
+      memmove(os->body_data,os->body_data+br,os->body_fill);
+    _crc_marks_shift(&os->crc,br);
+    os->body_returned=0;
+  }
 
-    og->header[22]=(unsigned char)(crc_reg&0xff);
-    og->header[23]=(unsigned char)((crc_reg>>8)&0xff);
-    og->header[24]=(unsigned char)((crc_reg>>16)&0xff);
-    og->header[25]=(unsigned char)((crc_reg>>24)&0xff);
+  /* segment table */
+  if(lr && (lr>=os->lacing_fill-lr ||
+            os->lacing_storage-lacing<=os->lacing_fill)){
+    if(os->lacing_fill-lr){
+      memmove(os->lacing_vals,os->lacing_vals+lr,
+              (os->lacing_fill-lr)*sizeof(*os->lacing_vals));
+      memmove(os->granule_vals,os->granule_vals+lr,
+              (os->lacing_fill-lr)*sizeof(*os->granule_vals));
+    }
+    os->lacing_fill-=lr;
+    /* only tracked while decoding */
+    os->lacing_packet=os->lacing_packet>lr?os->lacing_packet-lr:0;
+    os->lacing_returned=0;
   }
 }
 
+/* Store lacing vals for a packet of `bytes'; the room has been made */
+static void _os_lacing_packet(ogg_stream_state *os,long bytes,long e_o_s,
+                              ogg_int64_t granulepos){
+  long lacing_vals=bytes/255+1;
+  long i;
+
+  for(i=0;i<lacing_vals-1;i++){
+    os->lacing_vals[os->lacing_fill+i]=255;
+    os->granule_vals[os->lacing_fill+i]=os->granulepos;
+  }
+  os->lacing_vals[os->lacing_fill+i]=bytes%255;
+  os->granulepos=os->granule_vals[os->lacing_fill+i]=granulepos;
+
+  /* flag the first segment as the beginning of the packet */
+  os->lacing_vals[os->lacing_fill]|= 0x100;
+
+  os->lacing_fill+=lacing_vals;
+
+  /* for the sake of completeness */
+  os->packetno++;
+
+  if(e_o_s)os->e_o_s=1;
+}
+
 /* submit data to the internal buffer of the framing engine */
 int ogg_stream_iovecin(ogg_stream_state *os, ogg_iovec_t *iov, int count,
                        long e_o_s, ogg_int64_t granulepos){
@@ -308,21 +673,16 @@ int ogg_stream_iovecin(ogg_stream_state *os, ogg_iovec_t *iov, int count,
 
   if(ogg_stream_check(os)) return -1;
   if(!iov) return 0;
+  /* no copying while bodies held by reference are pending */
+  if(os->refs.fill>os->refs.returned) return -1;
 
   for (i = 0; i < count; ++i) bytes += (int)iov[i].iov_len;
   lacing_vals=bytes/255+1;
 
-  if(os->body_returned){
-    /* advance packet data according to the body_returned pointer. We
-       had to keep it around to return a pointer into the buffer last
-       call */
-
-    os->body_fill-=os->body_returned;
-    if(os->body_fill)
-      memmove(os->body_data,os->body_data+os->body_returned,
-              os->body_fill);
-    os->body_returned=0;
-  }
+  /* advance packet data according to the body_returned pointer. We
+     had to keep it around to return a pointer into the buffer last
+     call */
+  _os_compact(os,bytes,lacing_vals);
 
   /* make sure we have the buffer storage */
   if(_os_body_expand(os,bytes) || _os_lacing_expand(os,lacing_vals))
@@ -331,31 +691,15 @@ int ogg_stream_iovecin(ogg_stream_state *os, ogg_iovec_t *iov, int count,
   /* Copy in the submitted packet.  Yes, the copy is a waste; this is
      the liability of overly clean abstraction for the time being.  It
      will actually be fairly easy to eliminate the extra copy in the
-     future */
+     future. The body is checksummed on the way in. */
 
   for (i = 0; i < count; ++i) {
-    memcpy(os->body_data+os->body_fill, iov[i].iov_base, iov[i].iov_len);
+    _crc_marks_copy(&os->crc, os->body_data, os->body_fill,
+                    iov[i].iov_base, (long)iov[i].iov_len);
     os->body_fill += (int)iov[i].iov_len;
   }
 
-  /* Store lacing vals for this packet */
-  for(i=0;i<lacing_vals-1;i++){
-    os->lacing_vals[os->lacing_fill+i]=255;
-    os->granule_vals[os->lacing_fill+i]=os->granulepos;
-  }
-  os->lacing_vals[os->lacing_fill+i]=bytes%255;
-  os->granulepos=os->granule_vals[os->lacing_fill+i]=granulepos;
-
-  /* flag the first segment as the beginning of the packet */
-  os->lacing_vals[os->lacing_fill]|= 0x100;
-
-  os->lacing_fill+=lacing_vals;
-
-  /* for the sake of completeness */
-  os->packetno++;
-
-  if(e_o_s)os->e_o_s=1;
-
+  _os_lacing_packet(os,bytes,e_o_s,granulepos);
   return(0);
 }
 
@@ -366,19 +710,106 @@ int ogg_stream_packetin(ogg_stream_state *os,ogg_packet *op){
   return ogg_stream_iovecin(os, &iov, 1, op->e_o_s, op->granulepos);
 }
 
+/* Submits a packet by reference: rather than copying the body into
+   the stream, only op->packet is recorded, and the body is copied
+   straight into the pages that carry it, by ogg_stream_gather(). The
+   body must stay in place and unchanged until os->refs.released has
+   counted past it (one per ogg_stream_packetin_ref() call). Bodies
+   can't be held by reference and by copy at the same time: while
+   either kind is buffered, submitting the other fails. */
+
+int ogg_stream_packetin_ref(ogg_stream_state *os,ogg_packet *op){
+  ogg_stream_refs *r=&os->refs;
+  long lacing_vals;
+
+  if(ogg_stream_check(os)) return -1;
+  if(op->bytes<0 || os->body_fill>os->body_returned) return -1;
+  lacing_vals=op->bytes/255+1;
+
+  _os_compact(os,0,lacing_vals);
+  if(_os_lacing_expand(os,lacing_vals)) return -1;
+
+  /* drop the references paged out, as lazily as _os_compact() */
+  if(r->returned && r->returned>=r->fill-r->returned){
+    r->fill-=r->returned;
+    memmove(r->iov,r->iov+r->returned,r->fill*sizeof(*r->iov));
+    r->returned=0;
+  }
+  if(r->fill>=r->storage){
+    long storage=r->storage*2+16;
+    void *ret=_ogg_realloc(r->iov,storage*sizeof(*r->iov));
+    if(!ret) return -1;
+    r->iov=ret;
+    r->storage=storage;
+  }
+  r->iov[r->fill].iov_base=op->packet;
+  r->iov[r->fill].iov_len=op->bytes;
+  r->fill++;
+
+  _os_lacing_packet(os,op->bytes,op->e_o_s,op->granulepos);
+  return(0);
+}
+
+/* Copies the body of a page that ogg_stream_pageout_ref() returned
+   without one (og->body NULL) to `body', which must have room for
+   og->body_len bytes, points og->body at it and sets the checksum.
+   Has to happen before the stream is paged out again. */
+
+void ogg_stream_gather(ogg_stream_state *os,ogg_page *og,
+                       unsigned char *body){
+  ogg_stream_refs *r=&os->refs;
+  ogg_uint32_t crc_reg=_os_update_crc(0,og->header,og->header_len);
+  unsigned char *p=body;
+  long left=og->body_len;
+
+  for(;;){
+    /* release every body that is done with, including empty ones */
+    while(r->returned<r->fill &&
+          r->offset==(long)r->iov[r->returned].iov_len){
+      r->returned++;
+      r->offset=0;
+      r->released++;
+    }
+    if(!left || r->returned==r->fill)break;
+    {
+      ogg_iovec_t *v=r->iov+r->returned;
+      long n=(long)v->iov_len-r->offset;
+      if(n>left)n=left;
+      memcpy(p,(unsigned char *)v->iov_base+r->offset,n);
+      crc_reg=_os_update_crc(crc_reg,p,n);
+      p+=n;
+      left-=n;
+      r->offset+=n;
+    }
+  }
+
+  og->body=body;
+  _os_set_crc(og->header,crc_reg);
+}
+
 /* Conditionally flush a page; force==0 will only flush nominal-size
    pages, force==1 forces us to flush a page regardless of page size
    so long as there's any data available at all. */
-static int ogg_stream_flush_i(ogg_stream_state *os,ogg_page *og, int force, int nfill){
+static int ogg_stream_flush_i(ogg_stream_state *os,ogg_page *og, int force, int nfill,
+                              int gather){
   int i;
   int vals=0;
-  int maxvals=(os->lacing_fill>255?255:os->lacing_fill);
+  /* segments before lacing_returned went out on earlier pages */
+  int *lacing_vals=os->lacing_vals+os->lacing_returned;
+  ogg_int64_t *granule_vals=os->granule_vals+os->lacing_returned;
+  long lacing_fill=os->lacing_fill-os->lacing_returned;
+  int maxvals=(lacing_fill>255?255:(int)lacing_fill);
   int bytes=0;
   long acc=0;
   ogg_int64_t granule_pos=-1;
 
   if(ogg_stream_check(os)) return(0);
-  if(maxvals==0) return(0);
+  if(maxvals==0){
+    if(!os->end_page) return(0);
+    /* the empty last page of ogg_stream_end() */
+    os->end_page=0;
+    force=1;
+  }
 
   /* construct a page */
   /* decide how many segments to include */
@@ -388,7 +819,7 @@ static int ogg_stream_flush_i(ogg_stream_state *os,ogg_page *og, int force, int
   if(os->b_o_s==0){  /* 'initial header page' case */
     granule_pos=0;
     for(vals=0;vals<maxvals;vals++){
-      if((os->lacing_vals[vals]&0x0ff)<255){
+      if((lacing_vals[vals]&0x0ff)<255){
         vals++;
         break;
       }
@@ -411,9 +842,9 @@ static int ogg_stream_flush_i(ogg_stream_state *os,ogg_page *og, int force, int
         force=1;
         break;
       }
-      acc+=os->lacing_vals[vals]&0x0ff;
-      if((os->lacing_vals[vals]&0xff)<255){
-        granule_pos=os->granule_vals[vals];
+      acc+=lacing_vals[vals]&0x0ff;
+      if((lacing_vals[vals]&0xff)<255){
+        granule_pos=granule_vals[vals];
         packet_just_done=++packets_done;
       }else
         packet_just_done=0;
@@ -421,6 +852,7 @@ static int ogg_stream_flush_i(ogg_stream_state *os,ogg_page *og, int force, int
     if(vals==255)force=1;
   }
 
+  if(maxvals==0)granule_pos=os->granulepos;
   if(!force) return(0);
 
   /* construct the header in temp storage */
@@ -431,11 +863,11 @@ static int ogg_stream_flush_i(ogg_stream_state *os,ogg_page *og, int force, int
 
   /* continued packet flag? */
   os->header[5]=0x00;
-  if((os->lacing_vals[0]&0x100)==0)os->header[5]|=0x01;
+  if(vals>0 && (lacing_vals[0]&0x100)==0)os->header[5]|=0x01;
   /* first page flag? */
   if(os->b_o_s==0)os->header[5]|=0x02;
   /* last page flag? */
-  if(os->e_o_s && os->lacing_fill==vals)os->header[5]|=0x04;
+  if(os->e_o_s && lacing_fill==vals)os->header[5]|=0x04;
   os->b_o_s=1;
 
   /* 64 bits of PCM position */
@@ -477,7 +909,7 @@ static int ogg_stream_flush_i(ogg_stream_state *os,ogg_page *og, int force, int
   /* segment table */
   os->header[26]=(unsigned char)(vals&0xff);
   for(i=0;i<vals;i++)
-    bytes+=os->header[i+27]=(unsigned char)(os->lacing_vals[i]&0xff);
+    bytes+=os->header[i+27]=(unsigned char)(lacing_vals[i]&0xff);
 
   /* set pointers in the ogg_page struct */
   og->header=os->header;
@@ -485,16 +917,33 @@ static int ogg_stream_flush_i(ogg_stream_state *os,ogg_page *og, int force, int
   og->body=os->body_data+os->body_returned;
   og->body_len=bytes;
 
-  /* advance the lacing data and set the body_returned pointer */
+  /* advance the lacing data and set the body_returned pointer; both
+     are compacted lazily by the next ogg_stream_packetin() */
 
-  os->lacing_fill-=vals;
-  memmove(os->lacing_vals,os->lacing_vals+vals,os->lacing_fill*sizeof(*os->lacing_vals));
-  memmove(os->granule_vals,os->granule_vals+vals,os->lacing_fill*sizeof(*os->granule_vals));
+  os->lacing_returned+=vals;
+
+  if(os->refs.fill>os->refs.returned){
+    /* the bodies are held by reference; either the caller gathers the
+       page body, or it is gathered into body_data, which holds no
+       copied bodies at this point */
+    og->body=NULL;
+    if(gather){
+      _os_compact(os,bytes,0);
+      if(_os_body_expand(os,bytes)) return(0);
+      ogg_stream_gather(os,og,os->body_data+os->body_fill);
+    }
+    return(1);
+  }
   os->body_returned+=bytes;
 
   /* calculate the checksum */
 
-  ogg_page_checksum_set(og);
+  {
+    ogg_uint32_t crc_reg=_os_update_crc(0,og->header,og->header_len);
+    crc_reg=_crc_marks_update(&os->crc,crc_reg,os->body_data,
+                              os->body_returned-bytes,os->body_returned);
+    _os_set_crc(og->header,crc_reg);
+  }
 
   /* done */
   return(1);
@@ -515,7 +964,7 @@ static int ogg_stream_flush_i(ogg_stream_state *os,ogg_page *og, int force, int
    a page regardless of size in the middle of a stream. */
 
 int ogg_stream_flush(ogg_stream_state *os,ogg_page *og){
-  return ogg_stream_flush_i(os,og,1,4096);
+  return ogg_stream_flush_i(os,og,1,4096,1);
 }
 
 /* Like the above, but an argument is provided to adjust the nominal
@@ -523,7 +972,7 @@ int ogg_stream_flush(ogg_stream_state *os,ogg_page *og){
    own delay based flushing */
 
 int ogg_stream_flush_fill(ogg_stream_state *os,ogg_page *og, int nfill){
-  return ogg_stream_flush_i(os,og,1,nfill);
+  return ogg_stream_flush_i(os,og,1,nfill,1);
 }
 
 /* This constructs pages from buffered packet segments.  The pointers
@@ -534,11 +983,11 @@ int ogg_stream_pageout(ogg_stream_state *os, ogg_page *og){
   int force=0;
   if(ogg_stream_check(os)) return 0;
 
-  if((os->e_o_s&&os->lacing_fill) ||          /* 'were done, now flush' case */
-     (os->lacing_fill&&!os->b_o_s))           /* 'initial header page' case */
+  if((os->e_o_s&&os->lacing_fill>os->lacing_returned) ||  /* 'were done, now flush' case */
+     (os->lacing_fill>os->lacing_returned&&!os->b_o_s))   /* 'initial header page' case */
     force=1;
 
-  return(ogg_stream_flush_i(os,og,force,4096));
+  return(ogg_stream_flush_i(os,og,force,4096,1));
 }
 
 /* Like the above, but an argument is provided to adjust the nominal
@@ -549,11 +998,50 @@ int ogg_stream_pageout_fill(ogg_stream_state *os, ogg_page *og, int nfill){
   int force=0;
   if(ogg_stream_check(os)) return 0;
 
-  if((os->e_o_s&&os->lacing_fill) ||          /* 'were done, now flush' case */
-     (os->lacing_fill&&!os->b_o_s))           /* 'initial header page' case */
+  if((os->e_o_s&&os->lacing_fill>os->lacing_returned) ||  /* 'were done, now flush' case */
+     (os->lacing_fill>os->lacing_returned&&!os->b_o_s))   /* 'initial header page' case */
+    force=1;
+
+  return(ogg_stream_flush_i(os,og,force,nfill,1));
+}
+
+/* Like ogg_stream_pageout(), or ogg_stream_flush() with `flush' set,
+   except that pages carrying bodies held by reference come back with
+   og->body NULL, for the caller to gather straight into its own
+   buffer with ogg_stream_gather() */
+
+int ogg_stream_pageout_ref(ogg_stream_state *os, ogg_page *og, int flush){
+  return ogg_stream_pageout_ref_fill(os,og,flush,4096);
+}
+
+/* Like the above, with the nominal page size of
+   ogg_stream_pageout_fill() */
+
+int ogg_stream_pageout_ref_fill(ogg_stream_state *os, ogg_page *og, int flush,
+                                int nfill){
+  int force=flush;
+  if(ogg_stream_check(os)) return 0;
+
+  if((os->e_o_s&&os->lacing_fill>os->lacing_returned) ||  /* 'were done, now flush' case */
+     (os->lacing_fill>os->lacing_returned&&!os->b_o_s))   /* 'initial header page' case */
     force=1;
 
-  return(ogg_stream_flush_i(os,og,force,nfill));
+  return(ogg_stream_flush_i(os,og,force,nfill,0));
+}
+
+/* Ends the logical stream after its last packet went in without
+   e_o_s set, say because the end wasn't known yet. If packets are
+   still buffered, the page that flushes the last of them carries the
+   eos flag. Otherwise the next ogg_stream_pageout() or
+   ogg_stream_flush() returns an empty eos page, with the granulepos
+   of the last packet. */
+
+int ogg_stream_end(ogg_stream_state *os){
+  if(ogg_stream_check(os)) return -1;
+  if(os->e_o_s) return 0;
+  os->e_o_s=1;
+  if(os->lacing_fill==os->lacing_returned)os->end_page=1;
+  return 0;
 }
 
 int ogg_stream_eos(ogg_stream_state *os){
@@ -585,10 +1073,68 @@ int ogg_sync_init(ogg_sync_state *oy){
   return(0);
 }
 
+/* Ring buffers for ogg_sync_state. The same memfd is mapped twice,
+   back to back, so any `storage' bytes starting within the first
+   mapping are contiguous in memory: compacting the buffer is just
+   advancing `data', and pages wrapping around the end of the ring
+   are still returned as plain pointers. */
+
+#ifdef OGG_SYNC_RING
+static unsigned char *_os_ring_map(long size){
+  unsigned char *base;
+  int fd=(int)syscall(__NR_memfd_create,"ogg_sync",1 /* MFD_CLOEXEC */);
+  if(fd<0)return NULL;
+  if(ftruncate(fd,size)){
+    close(fd);
+    return NULL;
+  }
+
+  /* reserve the address range, then put both views of the file in it */
+  base=mmap(NULL,2*size,PROT_NONE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+  if(base!=MAP_FAILED &&
+     (mmap(base,size,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_FIXED,
+           fd,0)==MAP_FAILED ||
+      mmap(base+size,size,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_FIXED,
+           fd,0)==MAP_FAILED)){
+    munmap(base,2*size);
+    base=MAP_FAILED;
+  }
+  close(fd);
+  return base==MAP_FAILED?NULL:base;
+}
+
+static void _os_ring_unmap(unsigned char *base,long size){
+  munmap(base,2*size);
+}
+
+/* moves the unread data into a new ring of at least `size' bytes */
+static int _os_ring_resize(ogg_sync_state *oy,long size){
+  long page=sysconf(_SC_PAGESIZE);
+  unsigned char *ring;
+  if(page<=0 || size>INT_MAX-page)return -1;
+  size=(size+page-1)/page*page;
+  ring=_os_ring_map(size);
+  if(!ring)return -1;
+  if(oy->fill)memcpy(ring,oy->data,oy->fill);
+  if(oy->ring)
+    _os_ring_unmap(oy->ring,oy->storage);
+  else if(oy->data)
+    _ogg_free(oy->data);
+  oy->data=oy->ring=ring;
+  oy->storage=size;
+  return 0;
+}
+#endif
+
 /* clear non-flat storage within */
 int ogg_sync_clear(ogg_sync_state *oy){
   if(oy){
+#ifdef OGG_SYNC_RING
+    if(oy->ring)_os_ring_unmap(oy->ring,oy->storage);
+    else
+#endif
     if(oy->data)_ogg_free(oy->data);
+    if(oy->crc.marks)_ogg_free(oy->crc.marks);
     memset(oy,0,sizeof(*oy));
   }
   return(0);
@@ -607,22 +1153,46 @@ int ogg_sync_check(ogg_sync_state *oy){
   return 0;
 }
 
-char *ogg_sync_buffer(ogg_sync_state *oy, long size){
-  if(ogg_sync_check(oy)) return NULL;
-
-  /* first, clear out any space that has been previously returned */
+/* clear out any space that has been previously returned */
+static void _os_sync_compact(ogg_sync_state *oy){
   if(oy->returned){
     oy->fill-=oy->returned;
-    if(oy->fill>0)
+    if(oy->ring){
+      oy->data+=oy->returned;
+      if(oy->data>=oy->ring+oy->storage)oy->data-=oy->storage;
+    }else if(oy->fill>0)
       memmove(oy->data,oy->data+oy->returned,oy->fill);
+    _crc_marks_shift(&oy->crc,oy->returned);
     oy->returned=0;
   }
+}
+
+char *ogg_sync_buffer(ogg_sync_state *oy, long size){
+  if(ogg_sync_check(oy)) return NULL;
+
+  _os_sync_compact(oy);
 
   if(size>oy->storage-oy->fill){
-    /* We need to extend the internal buffer */
-    long newsize=size+oy->fill+4096; /* an extra page to be nice */
+    /* We need to extend the internal buffer; at least an extra page
+       to be nice */
+    long newsize=size<0?-1:_os_grow(oy->storage,size+oy->fill,4096,
+                                    oy->growth_cap,INT_MAX);
     void *ret;
 
+    if(newsize<0){
+      ogg_sync_clear(oy);
+      return NULL;
+    }
+#ifdef OGG_SYNC_RING
+    if(oy->ring){
+      if(_os_ring_resize(oy,newsize)){
+        ogg_sync_clear(oy);
+        return NULL;
+      }
+      oy->reallocs++;
+      return((char *)oy->data+oy->fill);
+    }
+#endif
     if(oy->data)
       ret=_ogg_realloc(oy->data,newsize);
     else
@@ -633,6 +1203,7 @@ char *ogg_sync_buffer(ogg_sync_state *oy, long size){
     }
     oy->data=ret;
     oy->storage=newsize;
+    oy->reallocs++;
   }
 
   /* expose a segment at least as large as requested at the fill mark */
@@ -646,17 +1217,210 @@ int ogg_sync_wrote(ogg_sync_state *oy, long bytes){
   return(0);
 }
 
-/* sync the stream.  This is meant to be useful for finding page
-   boundaries.
+/* ogg_sync_buffer(), a copy of `data', and ogg_sync_wrote() in one
+   call. The data is checksummed as it is copied, so that
+   ogg_sync_pageseek() can verify the pages in it without a second
+   pass over their bodies (unless checksums aren't verified at all,
+   see ogg_sync_verify()). */
+
+int ogg_sync_write(ogg_sync_state *oy, const unsigned char *data, long bytes){
+  if(bytes<0)return -1;
+  if(!ogg_sync_buffer(oy,bytes))return -1;
+  if(oy->verify==OGG_VERIFY_ALWAYS)
+    _crc_marks_copy(&oy->crc,oy->data,oy->fill,data,bytes);
+  else
+    memcpy(oy->data+oy->fill,data,bytes);
+  oy->fill+=bytes;
+  return(0);
+}
 
-   return values for this:
-  -n) skipped n bytes
-   0) page not ready; more data (no bytes skipped)
-   n) page synced at current location; page length n bytes
+/* Bounds how far ogg_sync_buffer() overallocates: the buffer grows
+   geometrically, but by no more than `cap' bytes beyond what is
+   requested (0, the default, for no bound). */
 
-*/
+int ogg_sync_growth(ogg_sync_state *oy, long cap){
+  if(ogg_sync_check(oy) || cap<0)return -1;
+  oy->growth_cap=cap;
+  return(0);
+}
 
-long ogg_sync_pageseek(ogg_sync_state *oy,ogg_page *og){
+/* Releases buffer storage not taken up by unconsumed data, i.e. after
+   a burst of large pages. Like ogg_sync_buffer(), this invalidates the
+   pages returned so far. */
+
+int ogg_sync_shrink(ogg_sync_state *oy){
+  if(ogg_sync_check(oy))return -1;
+
+  _os_sync_compact(oy);
+
+  /* rings keep their size */
+  if(!oy->ring && oy->storage>oy->fill){
+    if(oy->fill){
+      void *ret=_ogg_realloc(oy->data,oy->fill);
+      if(!ret)return -1;
+      oy->data=ret;
+    }else{
+      _ogg_free(oy->data);
+      oy->data=NULL;
+    }
+    oy->storage=oy->fill;
+    oy->reallocs++;
+  }
+  if(!oy->crc.count && oy->crc.marks){
+    _ogg_free(oy->crc.marks);
+    oy->crc.marks=NULL;
+    oy->crc.storage=0;
+  }
+  return(0);
+}
+
+/* Switches `oy' to a ring buffer of at least `size' bytes (see
+   _os_ring_map()), keeping any data buffered so far. Compaction then
+   never moves data, and pages stay valid until the ring wraps around
+   onto them. The ring grows like the plain buffer when a write doesn't
+   fit. Returns -1 if rings aren't supported on this platform or the
+   mapping failed, in which case `oy' is left as it was. */
+
+int ogg_sync_ring(ogg_sync_state *oy, long size){
+  if(ogg_sync_check(oy) || size<=0)return -1;
+#ifdef OGG_SYNC_RING
+  _os_sync_compact(oy);
+  if(size<oy->fill)size=oy->fill;
+  return _os_ring_resize(oy,size);
+#else
+  return -1;
+#endif
+}
+
+/* Capture pattern search. Looks for "OggS" followed by a zero stream
+   structure version (the five bytes of the "OggS" literal), so that a
+   resync only stops where a page can really start, not at every 'O'.
+   Fewer than five bytes before `end' are accepted if they begin the
+   pattern, since the rest of it may still arrive. Returns `end' if
+   there is no candidate. */
+
+static unsigned char *_os_scan_capture_tail(unsigned char *p,
+                                            unsigned char *end){
+  for(;p<end;p++)
+    if(!memcmp(p,"OggS",end-p))return p;
+  return end;
+}
+
+static unsigned char *_os_scan_capture_c(unsigned char *p,
+                                         unsigned char *end){
+  while(end-p>=5){
+    unsigned char *o=memchr(p,'O',end-p-4);
+    if(!o){
+      p=end-4;
+      break;
+    }
+    if(!memcmp(o,"OggS",5))return o;
+    p=o+1;
+  }
+  return _os_scan_capture_tail(p,end);
+}
+
+#if defined(CRC_FOLD_X86)
+/* immintrin.h is included above */
+
+__attribute__((target("sse2")))
+static unsigned char *_os_scan_capture_sse2(unsigned char *p,
+                                            unsigned char *end){
+  const __m128i c0=_mm_set1_epi8('O');
+  const __m128i c1=_mm_set1_epi8('g');
+  const __m128i c3=_mm_set1_epi8('S');
+  const __m128i c4=_mm_setzero_si128();
+  int mask;
+
+  while(end-p>=16+4){
+    __m128i m=_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p),c0);
+    m=_mm_and_si128(m,_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p+1)),c1));
+    m=_mm_and_si128(m,_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p+2)),c1));
+    m=_mm_and_si128(m,_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p+3)),c3));
+    m=_mm_and_si128(m,_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p+4)),c4));
+    mask=_mm_movemask_epi8(m);
+    if(mask)return p+__builtin_ctz(mask);
+    p+=16;
+  }
+  return _os_scan_capture_c(p,end);
+}
+
+__attribute__((target("avx2")))
+static unsigned char *_os_scan_capture_avx2(unsigned char *p,
+                                            unsigned char *end){
+  const __m256i c0=_mm256_set1_epi8('O');
+  const __m256i c1=_mm256_set1_epi8('g');
+  const __m256i c3=_mm256_set1_epi8('S');
+  const __m256i c4=_mm256_setzero_si256();
+  unsigned int mask;
+
+  while(end-p>=32+4){
+    __m256i m=_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)p),c0);
+    m=_mm256_and_si256(m,_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p+1)),c1));
+    m=_mm256_and_si256(m,_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p+2)),c1));
+    m=_mm256_and_si256(m,_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p+3)),c3));
+    m=_mm256_and_si256(m,_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p+4)),c4));
+    mask=(unsigned int)_mm256_movemask_epi8(m);
+    if(mask)return p+__builtin_ctz(mask);
+    p+=32;
+  }
+  return _os_scan_capture_c(p,end);
+}
+
+/* picked when the library is loaded, like crc_fold */
+static unsigned char *(*capture_scan)(unsigned char *,unsigned char *)=
+  _os_scan_capture_c;
+
+__attribute__((constructor))
+static void _os_scan_capture_init(void){
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2"))
+    capture_scan=_os_scan_capture_avx2;
+  else if(__builtin_cpu_supports("sse2"))
+    capture_scan=_os_scan_capture_sse2;
+}
+
+static unsigned char *_os_scan_capture(unsigned char *p,unsigned char *end){
+  return capture_scan(p,end);
+}
+
+#elif defined(CRC_FOLD_ARM)
+/* NEON is part of the AArch64 baseline */
+
+static unsigned char *_os_scan_capture(unsigned char *p,unsigned char *end){
+  uint64_t mask;
+
+  while(end-p>=16+4){
+    uint8x16_t m=vceqq_u8(vld1q_u8(p),vdupq_n_u8('O'));
+    m=vandq_u8(m,vceqq_u8(vld1q_u8(p+1),vdupq_n_u8('g')));
+    m=vandq_u8(m,vceqq_u8(vld1q_u8(p+2),vdupq_n_u8('g')));
+    m=vandq_u8(m,vceqq_u8(vld1q_u8(p+3),vdupq_n_u8('S')));
+    m=vandq_u8(m,vceqq_u8(vld1q_u8(p+4),vdupq_n_u8(0)));
+    /* narrow to four bits per byte */
+    mask=vget_lane_u64(vreinterpret_u64_u8(
+                         vshrn_n_u16(vreinterpretq_u16_u8(m),4)),0);
+    if(mask)return p+(__builtin_ctzll(mask)>>2);
+    p+=16;
+  }
+  return _os_scan_capture_c(p,end);
+}
+
+#else
+#define _os_scan_capture _os_scan_capture_c
+#endif
+
+/* The seek loop is instantiated once per verification policy (see
+   ogg_sync_pageseek() below) with `verify' constant, so that the
+   policy isn't tested again for every page. */
+
+#if defined(__GNUC__)
+#define _os_specialize static __inline__ __attribute__((always_inline))
+#else
+#define _os_specialize static
+#endif
+
+_os_specialize long _os_pageseek(ogg_sync_state *oy,ogg_page *og,
+                                 const int verify){
   unsigned char *page=oy->data+oy->returned;
   unsigned char *next;
   long bytes=oy->fill-oy->returned;
@@ -667,8 +1431,8 @@ long ogg_sync_pageseek(ogg_sync_state *oy,ogg_page *og){
     int headerbytes,i;
     if(bytes<27)return(0); /* not enough for a header */
 
-    /* verify capture pattern */
-    if(memcmp(page,"OggS",4))goto sync_fail;
+    /* verify capture pattern and stream structure version */
+    if(memcmp(page,"OggS",5))goto sync_fail;
 
     headerbytes=page[26]+27;
     if(bytes<headerbytes)return(0); /* not enough for header + seg table */
@@ -683,27 +1447,18 @@ long ogg_sync_pageseek(ogg_sync_state *oy,ogg_page *og){
   if(oy->bodybytes+oy->headerbytes>bytes)return(0);
 
   /* The whole test page is buffered.  Verify the checksum */
-  {
-    /* Grab the checksum bytes, set the header field to zero */
-    char chksum[4];
-    ogg_page log;
-
-    memcpy(chksum,page+22,4);
-    memset(page+22,0,4);
-
-    /* set up a temp page struct and recompute the checksum */
-    log.header=page;
-    log.header_len=oy->headerbytes;
-    log.body=page+oy->headerbytes;
-    log.body_len=oy->bodybytes;
-    ogg_page_checksum_set(&log);
+  if(verify){
+    /* checksum the header with a zeroed checksum field, then the body
+       through the running CRC taken when it was written */
+    ogg_uint32_t crc_reg=_os_header_crc(page,oy->headerbytes);
+    crc_reg=_crc_marks_update(&oy->crc,crc_reg,oy->data,
+                              oy->returned+oy->headerbytes,
+                              oy->returned+oy->headerbytes+oy->bodybytes);
 
     /* Compare */
-    if(memcmp(chksum,page+22,4)){
+    if(_os_get_crc(page)!=crc_reg){
       /* D'oh.  Mismatch! Corrupt page (or miscapture and not a page
          at all) */
-      /* replace the computed checksum with the one actually read in */
-      memcpy(page+22,chksum,4);
 
       /* Bad checksum. Lose sync */
       goto sync_fail;
@@ -726,6 +1481,7 @@ long ogg_sync_pageseek(ogg_sync_state *oy,ogg_page *og){
     oy->returned+=(bytes=oy->headerbytes+oy->bodybytes);
     oy->headerbytes=0;
     oy->bodybytes=0;
+    oy->verify_count++;
     return(bytes);
   }
 
@@ -734,15 +1490,97 @@ long ogg_sync_pageseek(ogg_sync_state *oy,ogg_page *og){
   oy->headerbytes=0;
   oy->bodybytes=0;
 
-  /* search for possible capture */
-  next=memchr(page+1,'O',bytes-1);
-  if(!next)
-    next=oy->data+oy->fill;
+  /* search for possible capture; everything skipped is consumed, so
+     no byte is looked at twice */
+  next=_os_scan_capture(page+1,oy->data+oy->fill);
 
   oy->returned=(int)(next-oy->data);
   return((long)-(next-page));
 }
 
+/* sync the stream.  This is meant to be useful for finding page
+   boundaries.
+
+   return values for this:
+  -n) skipped n bytes
+   0) page not ready; more data (no bytes skipped)
+   n) page synced at current location; page length n bytes
+
+*/
+
+long ogg_sync_pageseek(ogg_sync_state *oy,ogg_page *og){
+  switch(oy->verify){
+  case OGG_VERIFY_NEVER:
+    return _os_pageseek(oy,og,0);
+  case OGG_VERIFY_SAMPLED:
+    return _os_pageseek(oy,og,oy->verify_count%oy->verify_interval==0);
+  default:
+    return _os_pageseek(oy,og,1);
+  }
+}
+
+/* Selects which pages ogg_sync_pageseek() checks the checksum of:
+   every page (OGG_VERIFY_ALWAYS, the default), every `interval'th page
+   (OGG_VERIFY_SAMPLED), or none at all (OGG_VERIFY_NEVER). Only meant
+   for trusted input, such as files written by a known muxer; with
+   verification off corrupt data makes it through to
+   ogg_stream_pagein(). */
+
+int ogg_sync_verify(ogg_sync_state *oy,int policy,int interval){
+  if(ogg_sync_check(oy))return -1;
+  if(policy==OGG_VERIFY_SAMPLED && interval<1)return -1;
+  if(policy!=OGG_VERIFY_ALWAYS && policy!=OGG_VERIFY_SAMPLED &&
+     policy!=OGG_VERIFY_NEVER)return -1;
+  oy->verify=policy;
+  oy->verify_interval=interval;
+  oy->verify_count=0;
+  return 0;
+}
+
+/* Like ogg_sync_pageseek(), but for data that is already in memory
+   as a whole: looks for a page at the start of data[0,bytes) without
+   copying anything into an ogg_sync_state. Pages are returned whether
+   or not their checksum verifies.
+
+   return values:
+  -n) no page starts at data; the next possible one is n bytes on
+   0) a page may start at data, but bytes doesn't reach its end
+   n) page of n bytes at data, set up in og (pointing into data);
+      *crc_ok is set to whether its checksum verifies
+*/
+
+long ogg_page_scan(const unsigned char *data,long bytes,ogg_page *og,
+                   int *crc_ok){
+  long headerbytes,bodybytes=0;
+  int i;
+
+  if(bytes<=0)return 0;
+  if(memcmp(data,"OggS",bytes<5?bytes:5)){
+    unsigned char *page=(unsigned char *)data;
+    return -(long)(_os_scan_capture(page+1,page+bytes)-page);
+  }
+
+  if(bytes<27)return 0;
+  headerbytes=data[26]+27;
+  if(bytes<headerbytes)return 0;
+  for(i=0;i<data[26];i++)
+    bodybytes+=data[27+i];
+  if(bytes<headerbytes+bodybytes)return 0;
+
+  if(crc_ok){
+    ogg_uint32_t crc_reg=_os_header_crc(data,headerbytes);
+    crc_reg=_os_update_crc(crc_reg,data+headerbytes,bodybytes);
+    *crc_ok=_os_get_crc(data)==crc_reg;
+  }
+  if(og){
+    og->header=(unsigned char *)data;
+    og->header_len=headerbytes;
+    og->body=(unsigned char *)data+headerbytes;
+    og->body_len=bodybytes;
+  }
+  return headerbytes+bodybytes;
+}
+
 /* sync the stream and get a page.  Keep trying until we find a page.
    Suppress 'sync errors' after reporting the first.
 
@@ -804,32 +1642,7 @@ int ogg_stream_pagein(ogg_stream_state *os, ogg_page *og){
 
   if(ogg_stream_check(os)) return -1;
 
-  /* clean up 'returned data' */
-  {
-    long lr=os->lacing_returned;
-    long br=os->body_returned;
-
-    /* body data */
-    if(br){
-      os->body_fill-=br;
-      if(os->body_fill)
-        memmove(os->body_data,os->body_data+br,os->body_fill);
-      os->body_returned=0;
-    }
-
-    if(lr){
-      /* segment table */
-      if(os->lacing_fill-lr){
-        memmove(os->lacing_vals,os->lacing_vals+lr,
-                (os->lacing_fill-lr)*sizeof(*os->lacing_vals));
-        memmove(os->granule_vals,os->granule_vals+lr,
-                (os->lacing_fill-lr)*sizeof(*os->granule_vals));
-      }
-      os->lacing_fill-=lr;
-      os->lacing_packet-=lr;
-      os->lacing_returned=0;
-    }
-  }
+  _os_compact(os,bodysize,segments+1);
 
   /* check the serial number */
   if(serialno!=os->serialno)return(-1);
@@ -921,6 +1734,8 @@ int ogg_sync_reset(ogg_sync_state *oy){
 
   oy->fill=0;
   oy->returned=0;
+  oy->crc.count=0;
+  oy->verify_count=0;
   oy->unsynced=0;
   oy->headerbytes=0;
   oy->bodybytes=0;
@@ -932,6 +1747,13 @@ int ogg_stream_reset(ogg_stream_state *os){
 
   os->body_fill=0;
   os->body_returned=0;
+  os->crc.count=0;
+
+  /* pending references count as released */
+  os->refs.released+=os->refs.fill-os->refs.returned;
+  os->refs.fill=0;
+  os->refs.returned=0;
+  os->refs.offset=0;
 
   os->lacing_fill=0;
   os->lacing_packet=0;
@@ -940,6 +1762,7 @@ int ogg_stream_reset(ogg_stream_state *os){
   os->header_fill=0;
 
   os->e_o_s=0;
+  os->end_page=0;
   os->b_o_s=0;
   os->pageno=-1;
   os->packetno=0;
@@ -955,6 +1778,58 @@ int ogg_stream_reset_serialno(ogg_stream_state *os,int serialno){
   return(0);
 }
 
+/* Bounds how far the body and lacing buffers overallocate, in bytes
+   and segments respectively; see ogg_sync_growth() */
+
+int ogg_stream_growth(ogg_stream_state *os,long cap){
+  if(ogg_stream_check(os) || cap<0) return -1;
+  os->growth_cap=cap;
+  return(0);
+}
+
+/* Releases body and lacing storage not taken up by buffered data,
+   i.e. once a large keyframe has been paged out. Invalidates the
+   pages and packets returned so far. */
+
+int ogg_stream_shrink(ogg_stream_state *os){
+  void *ret;
+  long storage;
+  if(ogg_stream_check(os)) return -1;
+
+  /* all of the storage counts as needed, which forces compaction */
+  _os_compact(os,os->body_storage,os->lacing_storage);
+
+  /* keep at least one element, body_data doubles as the
+     ogg_stream_check() flag */
+  storage=os->body_fill>0?os->body_fill:1;
+  if(os->body_storage>storage){
+    ret=_ogg_realloc(os->body_data,storage*sizeof(*os->body_data));
+    if(!ret)return -1;
+    os->body_data=ret;
+    os->body_storage=storage;
+    os->reallocs++;
+  }
+
+  storage=os->lacing_fill>0?os->lacing_fill:1;
+  if(os->lacing_storage>storage){
+    ret=_ogg_realloc(os->lacing_vals,storage*sizeof(*os->lacing_vals));
+    if(!ret)return -1;
+    os->lacing_vals=ret;
+    ret=_ogg_realloc(os->granule_vals,storage*sizeof(*os->granule_vals));
+    if(!ret)return -1;
+    os->granule_vals=ret;
+    os->lacing_storage=storage;
+    os->reallocs++;
+  }
+
+  if(!os->crc.count && os->crc.marks){
+    _ogg_free(os->crc.marks);
+    os->crc.marks=NULL;
+    os->crc.storage=0;
+  }
+  return(0);
+}
+
 static int _packetout(ogg_stream_state *os,ogg_packet *op,int adv){
 
   /* The last part of decode. We have the stream broken into packet
@@ -1141,6 +2016,100 @@ void error(void){
   exit(1);
 }
 
+/* the slicing tables must match the direct computation, and the sliced
+   CRC the bytewise one at every alignment */
+void test_crc(void){
+  unsigned char data[1024];
+  int i,j,k;
+
+  fprintf(stderr,"testing CRC tables... ");
+  for(i=0;i<256;i++){
+    if(crc_lookup[0][i]!=_ogg_crc_entry(i)){
+      fprintf(stderr,"crc_lookup[0][%d] mismatch!\n",i);
+      exit(1);
+    }
+    for(k=1;k<8;k++){
+      ogg_uint32_t prev=crc_lookup[k-1][i];
+      if(crc_lookup[k][i]!=((prev<<8)^crc_lookup[0][prev>>24])){
+        fprintf(stderr,"crc_lookup[%d][%d] mismatch!\n",k,i);
+        exit(1);
+      }
+    }
+  }
+  fprintf(stderr,"ok.\n");
+
+#if defined(CRC_FOLD_X86) || defined(CRC_FOLD_ARM)
+  fprintf(stderr,"testing sliced and %s CRC... ",
+          _crc_fold_supported()?"folded":"(unsupported) folded");
+#else
+  fprintf(stderr,"testing sliced CRC... ");
+#endif
+  for(i=0;i<(int)sizeof(data);i++)data[i]=rand();
+  for(i=0;i<16;i++){
+    for(j=0;j<(int)sizeof(data)-16;j+=13){
+      ogg_uint32_t ref=0;
+      for(k=0;k<j;k++)
+        ref=(ref<<8)^crc_lookup[0][((ref>>24)&0xff)^data[i+k]];
+      if(_os_update_crc_sliced(0,data+i,j)!=ref ||
+         _os_update_crc(0,data+i,j)!=ref ||
+         _os_update_crc(_os_update_crc(0,data+i,j/3),data+i+j/3,j-j/3)!=ref){
+        fprintf(stderr,"mismatch at offset %d length %d!\n",i,j);
+        exit(1);
+      }
+    }
+  }
+  fprintf(stderr,"ok.\n");
+
+  fprintf(stderr,"testing CRC checkpoints... ");
+  {
+    static unsigned char zeros[CRC_MARK_BYTES];
+    static unsigned char src[8192],buf[8192];
+    ogg_crc_marks m;
+    long fill=0;
+
+    if(crc_mark_shift[0]!=1){
+      fprintf(stderr,"crc_mark_shift[0] mismatch!\n");
+      exit(1);
+    }
+    for(i=1;i<CRC_MARK_SHIFTS;i++){
+      if(_os_update_crc_sliced(crc_mark_shift[i-1],zeros,CRC_MARK_BYTES)!=
+         crc_mark_shift[i]){
+        fprintf(stderr,"crc_mark_shift[%d] mismatch!\n",i);
+        exit(1);
+      }
+    }
+
+    /* copy in random runs, compacting now and then, and check random
+       ranges against a plain CRC */
+    memset(&m,0,sizeof(m));
+    for(i=0;i<(int)sizeof(src);i++)src[i]=rand();
+    for(i=0;i<2000;i++){
+      long n=rand()%1500;
+      long start,end;
+      ogg_uint32_t seed=rand();
+      if(fill+n>(long)sizeof(buf)){
+        long drop=rand()%(fill+1);
+        memmove(buf,buf+drop,fill-drop);
+        _crc_marks_shift(&m,drop);
+        fill-=drop;
+        if(fill+n>(long)sizeof(buf))n=sizeof(buf)-fill;
+      }
+      _crc_marks_copy(&m,buf,fill,src+rand()%(sizeof(src)-n),n);
+      fill+=n;
+
+      start=rand()%(fill+1);
+      end=start+rand()%(fill-start+1);
+      if(_crc_marks_update(&m,seed,buf,start,end)!=
+         _os_update_crc(seed,buf+start,end-start)){
+        fprintf(stderr,"mismatch over %ld-%ld!\n",start,end);
+        exit(1);
+      }
+    }
+    _ogg_free(m.marks);
+  }
+  fprintf(stderr,"ok.\n");
+}
+
 /* 17 only */
 const int head1_0[] = {0x4f,0x67,0x67,0x53,0,0x06,
                        0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
@@ -1543,23 +2512,29 @@ void test_pack(const int *pl, const int **headers, int byteskip,
         {
           ogg_page og_de;
           ogg_packet op_de,op_de2;
-          char *buf=ogg_sync_buffer(&oy,og.header_len+og.body_len);
-          char *next=buf;
-          byteskipcount+=og.header_len;
-          if(byteskipcount>byteskip){
-            memcpy(next,og.header,byteskipcount-byteskip);
-            next+=byteskipcount-byteskip;
-            byteskipcount=byteskip;
-          }
+          if(!byteskip){
+            /* checksummed on the way in */
+            ogg_sync_write(&oy,og.header,og.header_len);
+            ogg_sync_write(&oy,og.body,og.body_len);
+          }else{
+            char *buf=ogg_sync_buffer(&oy,og.header_len+og.body_len);
+            char *next=buf;
+            byteskipcount+=og.header_len;
+            if(byteskipcount>byteskip){
+              memcpy(next,og.header,byteskipcount-byteskip);
+              next+=byteskipcount-byteskip;
+              byteskipcount=byteskip;
+            }
 
-          byteskipcount+=og.body_len;
-          if(byteskipcount>byteskip){
-            memcpy(next,og.body,byteskipcount-byteskip);
-            next+=byteskipcount-byteskip;
-            byteskipcount=byteskip;
-          }
+            byteskipcount+=og.body_len;
+            if(byteskipcount>byteskip){
+              memcpy(next,og.body,byteskipcount-byteskip);
+              next+=byteskipcount-byteskip;
+              byteskipcount=byteskip;
+            }
 
-          ogg_sync_wrote(&oy,next-buf);
+            ogg_sync_wrote(&oy,next-buf);
+          }
 
           while(1){
             int ret=ogg_sync_pageout(&oy,&og_de);
@@ -1653,8 +2628,441 @@ void test_pack(const int *pl, const int **headers, int byteskip,
   fprintf(stderr,"ok.\n");
 }
 
+void test_capture(void){
+  static unsigned char data[4096];
+  int i,j,n;
+
+  fprintf(stderr,"testing capture search... ");
+  for(n=0;n<200;n++){
+    /* junk heavy on pattern bytes, with a few real captures */
+    for(i=0;i<(int)sizeof(data);i++)data[i]="OggS\0x"[rand()%6];
+    for(i=rand()%8;i>0;i--)memcpy(data+rand()%(sizeof(data)-5),"OggS",5);
+
+    for(i=0;i<64;i++){
+      unsigned char *end=data+sizeof(data)-rand()%64;
+      unsigned char *ref=data+i;
+      unsigned char *got[4];
+      for(;ref<end;ref++)
+        if(!memcmp(ref,"OggS",end-ref<5?end-ref:5))break;
+      got[0]=_os_scan_capture_c(data+i,end);
+      got[1]=_os_scan_capture(data+i,end);
+#if defined(CRC_FOLD_X86)
+      got[2]=_os_scan_capture_sse2(data+i,end);
+      got[3]=__builtin_cpu_supports("avx2")?
+        _os_scan_capture_avx2(data+i,end):ref;
+#else
+      got[2]=got[3]=ref;
+#endif
+      for(j=0;j<4;j++){
+        if(got[j]!=ref){
+          fprintf(stderr,"scanner %d mismatch at offset %d!\n",j,i);
+          exit(1);
+        }
+      }
+    }
+  }
+  fprintf(stderr,"ok.\n");
+}
+
+/* ogg_page_scan() over pages laid out back to back, with junk and a
+   corrupted page in between */
+void test_scan(void){
+  static unsigned char data[8192];
+  unsigned char *p=data;
+  ogg_stream_state os;
+  ogg_packet op;
+  ogg_page og;
+  long pos=0,ret,page[3];
+  int crc_ok,found=0,i;
+
+  fprintf(stderr,"testing stateless page scan... ");
+  ogg_stream_init(&os,0x1234);
+  memset(&op,0,sizeof(op));
+  op.packet=data+4096;
+  for(i=0;i<3;i++){
+    op.bytes=300+i*500;
+    op.b_o_s=i==0;
+    op.packetno=i;
+    ogg_stream_packetin(&os,&op);
+    ogg_stream_flush(&os,&og);
+    memcpy(p,"xOgg",4);
+    p+=4;
+    page[i]=p-data;
+    memcpy(p,og.header,og.header_len);
+    memcpy(p+og.header_len,og.body,og.body_len);
+    p+=og.header_len+og.body_len;
+  }
+  ogg_stream_clear(&os);
+  data[page[1]+40]^=1;
+
+  while((ret=ogg_page_scan(data+pos,p-data-pos,&og,&crc_ok))!=0){
+    if(ret<0){
+      pos-=ret;
+      continue;
+    }
+    if(pos!=page[found] || crc_ok!=(found!=1) ||
+       ogg_page_serialno(&og)!=0x1234 || ogg_page_pageno(&og)!=found){
+      fprintf(stderr,"unexpected page at %ld!\n",pos);
+      exit(1);
+    }
+    found++;
+    pos+=ret;
+  }
+  if(found!=3 || pos!=p-data){
+    fprintf(stderr,"found %d pages, stopped at %ld!\n",found,pos);
+    exit(1);
+  }
+
+  /* a page cut short asks for more data */
+  if(ogg_page_scan(data+page[2],p-data-page[2]-1,&og,&crc_ok)!=0){
+    fprintf(stderr,"truncated page not detected!\n");
+    exit(1);
+  }
+  fprintf(stderr,"ok.\n");
+}
+
+/* pages 1 and 4 of six are corrupt; count what each policy lets by */
+void test_verify(void){
+  static const struct { int policy,interval,pages; } cases[]={
+    {OGG_VERIFY_ALWAYS,0,4},
+    {OGG_VERIFY_SAMPLED,2,5},  /* checks pages 0, 2 and 4 */
+    {OGG_VERIFY_SAMPLED,3,6},  /* checks pages 0 and 3 only */
+    {OGG_VERIFY_NEVER,0,6}
+  };
+  static unsigned char packet[500];
+  ogg_stream_state os;
+  ogg_sync_state sy;
+  ogg_packet op;
+  ogg_page og;
+  int i,n;
+
+  fprintf(stderr,"testing verification policies... ");
+  if(ogg_sync_init(&sy) || !ogg_sync_verify(&sy,OGG_VERIFY_SAMPLED,0) ||
+     !ogg_sync_verify(&sy,7,1)){
+    fprintf(stderr,"bad policy accepted!\n");
+    exit(1);
+  }
+  for(n=0;n<(int)(sizeof(cases)/sizeof(*cases));n++){
+    int pages=0,ret;
+    ogg_sync_reset(&sy);
+    ogg_sync_verify(&sy,cases[n].policy,cases[n].interval);
+    ogg_stream_init(&os,0x4321);
+    memset(&op,0,sizeof(op));
+    op.packet=packet;
+    op.bytes=sizeof(packet);
+    for(i=0;i<6;i++){
+      op.b_o_s=i==0;
+      op.packetno=i;
+      ogg_stream_packetin(&os,&op);
+      ogg_stream_flush(&os,&og);
+      if(i==1 || i==4)og.body[10]^=0x20;
+      ogg_sync_write(&sy,og.header,og.header_len);
+      ogg_sync_write(&sy,og.body,og.body_len);
+    }
+    ogg_stream_clear(&os);
+    while((ret=ogg_sync_pageseek(&sy,&og))!=0)
+      if(ret>0)pages++;
+    if(pages!=cases[n].pages){
+      fprintf(stderr,"policy %d/%d passed %d pages!\n",
+              cases[n].policy,cases[n].interval,pages);
+      exit(1);
+    }
+  }
+  ogg_sync_clear(&sy);
+  fprintf(stderr,"ok.\n");
+}
+
+/* a megabyte buffered in 4k pieces costs a handful of reallocs,
+   and shrinking gives it all back */
+void test_growth(void){
+  static unsigned char chunk[4096];
+  ogg_stream_state os;
+  ogg_sync_state sy;
+  ogg_packet op;
+  ogg_page og;
+  int i;
+
+  fprintf(stderr,"testing buffer growth... ");
+  ogg_sync_init(&sy);
+  for(i=0;i<256;i++)
+    ogg_sync_write(&sy,chunk,sizeof(chunk));
+  if(sy.reallocs>10 || sy.storage<sy.fill){
+    fprintf(stderr,"%ld sync reallocs!\n",sy.reallocs);
+    exit(1);
+  }
+  ogg_sync_reset(&sy);
+  if(ogg_sync_shrink(&sy) || sy.storage!=0 || sy.data){
+    fprintf(stderr,"sync buffer not released!\n");
+    exit(1);
+  }
+
+  /* a cap bounds the headroom */
+  ogg_sync_growth(&sy,4096);
+  for(i=0;i<256;i++){
+    ogg_sync_write(&sy,chunk,sizeof(chunk));
+    if(sy.storage-sy.fill>4096){
+      fprintf(stderr,"%d bytes of headroom!\n",sy.storage-sy.fill);
+      exit(1);
+    }
+  }
+  ogg_sync_clear(&sy);
+
+  ogg_stream_init(&os,0x1234);
+  memset(&op,0,sizeof(op));
+  op.packet=chunk;
+  op.bytes=sizeof(chunk);
+  for(i=0;i<256;i++){
+    op.b_o_s=i==0;
+    op.packetno=i;
+    ogg_stream_packetin(&os,&op);
+  }
+  if(os.reallocs>10){
+    fprintf(stderr,"%ld stream reallocs!\n",os.reallocs);
+    exit(1);
+  }
+  while(ogg_stream_flush(&os,&og));
+  if(ogg_stream_shrink(&os) || os.body_storage!=1 || os.lacing_storage!=1){
+    fprintf(stderr,"stream buffers not released!\n");
+    exit(1);
+  }
+  op.b_o_s=0;
+  op.packetno=i;
+  if(ogg_stream_packetin(&os,&op) || !ogg_stream_flush(&os,&og) ||
+     og.body_len!=(long)sizeof(chunk)){
+    fprintf(stderr,"stream unusable after shrinking!\n");
+    exit(1);
+  }
+  ogg_stream_clear(&os);
+  fprintf(stderr,"ok.\n");
+}
+
+/* stream pages through a small ring, so that most of them wrap
+   around its end */
+void test_ring(void){
+  static unsigned char packet[700];
+  ogg_stream_state os,od;
+  ogg_sync_state sy;
+  ogg_packet op;
+  ogg_page og;
+  unsigned char *big;
+  long storage;
+  int i,j;
+
+  fprintf(stderr,"testing ring buffer... ");
+  ogg_sync_init(&sy);
+  if(ogg_sync_ring(&sy,4096)){
+    ogg_sync_clear(&sy);
+    fprintf(stderr,"not supported here, skipped.\n");
+    return;
+  }
+  storage=sy.storage;
+  ogg_stream_init(&os,0x2222);
+  ogg_stream_init(&od,0x2222);
+  memset(&op,0,sizeof(op));
+  for(i=0;i<100;i++){
+    for(j=0;j<(int)sizeof(packet);j++)packet[j]=(unsigned char)(i+j);
+    op.packet=packet;
+    op.bytes=sizeof(packet)-i;
+    op.b_o_s=i==0;
+    op.packetno=i;
+    ogg_stream_packetin(&os,&op);
+    ogg_stream_flush(&os,&og);
+    ogg_sync_write(&sy,og.header,og.header_len);
+    ogg_sync_write(&sy,og.body,og.body_len);
+    if(ogg_sync_pageout(&sy,&og)!=1 || ogg_stream_pagein(&od,&og) ||
+       ogg_stream_packetout(&od,&op)!=1 || op.bytes!=(long)sizeof(packet)-i ||
+       memcmp(op.packet,packet,op.bytes)){
+      fprintf(stderr,"page %d mangled!\n",i);
+      exit(1);
+    }
+  }
+  if(sy.storage!=storage || sy.reallocs){
+    fprintf(stderr,"ring was reallocated!\n");
+    exit(1);
+  }
+
+  /* a write that doesn't fit grows the ring, keeping its contents */
+  big=_ogg_malloc(storage);
+  for(j=0;j<storage;j++)big[j]=(unsigned char)(j*7);
+  ogg_sync_write(&sy,packet,100);
+  ogg_sync_write(&sy,big,storage);
+  if(sy.storage<=storage || sy.reallocs!=1 || memcmp(sy.data,packet,100) ||
+     memcmp(sy.data+100,big,storage)){
+    fprintf(stderr,"ring not grown!\n");
+    exit(1);
+  }
+  _ogg_free(big);
+  ogg_stream_clear(&os);
+  ogg_stream_clear(&od);
+  ogg_sync_clear(&sy);
+  fprintf(stderr,"ok.\n");
+}
+
+/* packets submitted by reference come out in the same pages as
+   copied ones, whether the caller or the stream gathers the bodies,
+   also with a nominal page size other than the default */
+void test_ref(void){
+  static const long sizes[]={100,0,3000,70000,255,0,17,9000,254,500};
+  const int n=sizeof(sizes)/sizeof(*sizes);
+  unsigned char *data=_ogg_malloc(100000);
+  unsigned char *copy=_ogg_malloc(200000);
+  unsigned char *ref=_ogg_malloc(200000);
+  ogg_stream_state os;
+  ogg_packet op;
+  ogg_page og;
+  long copied=0,mode,len,i;
+
+  fprintf(stderr,"testing packets by reference... ");
+  for(i=0;i<100000;i++)data[i]=(unsigned char)(i*31+(i>>8));
+
+  /* modes 3 and 4 repeat 0 and 1 with smaller pages */
+  for(mode=0;mode<5;mode++){
+    unsigned char *out=mode%3?ref:copy;
+    int byref=mode%3!=0,fill=mode<3?4096:1000;
+    len=0;
+    ogg_stream_init(&os,0x5555);
+    memset(&op,0,sizeof(op));
+    for(i=0;i<n;i++){
+      op.packet=data+i*7;
+      op.bytes=sizeof(*data)*sizes[i];
+      op.b_o_s=i==0;
+      op.e_o_s=i==n-1;
+      op.granulepos=i*1000;
+      op.packetno=i;
+      if(byref?ogg_stream_packetin_ref(&os,&op):ogg_stream_packetin(&os,&op)){
+        fprintf(stderr,"packetin failed!\n");
+        exit(1);
+      }
+      /* page out as we go, with the last flush below */
+      while(mode%3==1?ogg_stream_pageout_ref_fill(&os,&og,0,fill):
+            ogg_stream_pageout_fill(&os,&og,fill)){
+        if(!og.body)ogg_stream_gather(&os,&og,out+len+og.header_len);
+        else memcpy(out+len+og.header_len,og.body,og.body_len);
+        memcpy(out+len,og.header,og.header_len);
+        len+=og.header_len+og.body_len;
+      }
+    }
+    while(mode%3==1?ogg_stream_pageout_ref_fill(&os,&og,1,fill):
+          ogg_stream_flush_fill(&os,&og,fill)){
+      if(!og.body)ogg_stream_gather(&os,&og,out+len+og.header_len);
+      else memcpy(out+len+og.header_len,og.body,og.body_len);
+      memcpy(out+len,og.header,og.header_len);
+      len+=og.header_len+og.body_len;
+    }
+    if(!byref)copied=len;
+    else if(len!=copied || memcmp(copy,ref,len)){
+      fprintf(stderr,"mode %ld pages differ!\n",mode);
+      exit(1);
+    }
+    if(byref && (os.refs.released!=n || os.refs.fill!=os.refs.returned)){
+      fprintf(stderr,"%ld of %d references released!\n",
+              (long)os.refs.released,n);
+      exit(1);
+    }
+    ogg_stream_clear(&os);
+  }
+
+  /* no mixing */
+  ogg_stream_init(&os,0x5555);
+  op.bytes=10;
+  if(ogg_stream_packetin_ref(&os,&op) || !ogg_stream_packetin(&os,&op)){
+    fprintf(stderr,"copy after reference accepted!\n");
+    exit(1);
+  }
+  ogg_stream_reset(&os);
+  if(os.refs.released!=1 || ogg_stream_packetin(&os,&op) ||
+     !ogg_stream_packetin_ref(&os,&op)){
+    fprintf(stderr,"reference after copy accepted!\n");
+    exit(1);
+  }
+  ogg_stream_clear(&os);
+
+  _ogg_free(data);
+  _ogg_free(copy);
+  _ogg_free(ref);
+  fprintf(stderr,"ok.\n");
+}
+
+/* ogg_stream_end() marks the last page after the fact: the page still
+   holding packets when there is one, else an empty page of its own
+   that decodes as the end of the stream */
+void test_end(void){
+  unsigned char data[100];
+  ogg_stream_state os,od;
+  ogg_sync_state sy;
+  ogg_packet op;
+  ogg_page og;
+  int pending,pages;
+
+  fprintf(stderr,"testing end of stream after the last packet... ");
+  memset(data,7,sizeof(data));
+  for(pending=0;pending<2;pending++){
+    ogg_stream_init(&os,0x1234);
+    ogg_stream_init(&od,0x1234);
+    ogg_sync_init(&sy);
+    memset(&op,0,sizeof(op));
+    op.packet=data;
+    op.bytes=sizeof(data);
+    for(op.packetno=0;op.packetno<3;op.packetno++){
+      op.b_o_s=op.packetno==0;
+      op.granulepos=op.packetno*960;
+      ogg_stream_packetin(&os,&op);
+      if(!pending || op.packetno<2)
+        while(ogg_stream_flush(&os,&og)){
+          ogg_sync_write(&sy,og.header,og.header_len);
+          ogg_sync_write(&sy,og.body,og.body_len);
+        }
+    }
+    if(ogg_stream_end(&os) || !ogg_stream_eos(&os)){
+      fprintf(stderr,"stream not ended!\n");
+      exit(1);
+    }
+    pages=0;
+    while(ogg_stream_pageout(&os,&og)){
+      if(!ogg_page_eos(&og) || ogg_page_granulepos(&og)!=1920 ||
+         og.body_len!=(pending?100:0)){
+        fprintf(stderr,"bad last page!\n");
+        exit(1);
+      }
+      ogg_sync_write(&sy,og.header,og.header_len);
+      ogg_sync_write(&sy,og.body,og.body_len);
+      pages++;
+    }
+    if(pages!=1 || ogg_stream_flush(&os,&og)){
+      fprintf(stderr,"%d last pages!\n",pages);
+      exit(1);
+    }
+    /* it all decodes, to the three packets and the end */
+    pages=0;
+    while(ogg_sync_pageout(&sy,&og)==1){
+      if(ogg_stream_pagein(&od,&og)){
+        fprintf(stderr,"page rejected!\n");
+        exit(1);
+      }
+      while(ogg_stream_packetout(&od,&op)==1)pages++;
+    }
+    if(pages!=3 || !od.e_o_s){
+      fprintf(stderr,"bad decode of the end!\n");
+      exit(1);
+    }
+    ogg_stream_clear(&os);
+    ogg_stream_clear(&od);
+    ogg_sync_clear(&sy);
+  }
+  fprintf(stderr,"ok.\n");
+}
+
 int main(void){
 
+  test_crc();
+  test_capture();
+  test_scan();
+  test_verify();
+  test_growth();
+  test_ring();
+  test_ref();
+  test_end();
+
   ogg_stream_init(&os_en,0x04030201);
   ogg_stream_init(&os_de,0x04030201);
   ogg_sync_init(&oy);
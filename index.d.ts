@@ -1,14 +1,59 @@
-import { Readable, Writable } from 'stream'
+import { Readable, ReadableOptions, Transform, Writable, WritableOptions } from 'stream'
+
+export interface EncoderOptions extends ReadableOptions {
+    asyncThreshold?: number;
+    interleave?: boolean;
+    maxInterleaveDelay?: number;
+    maxInterleavePages?: number;
+    flushDeadline?: number;
+}
+
+export interface EncoderStreamOptions {
+    granuleRate?: number;
+    granuleTime?: (granulepos: bigint) => number;
+    zeroCopy?: boolean;
+    pageBytes?: number;
+    pageDuration?: number;
+}
+
+export interface DecoderOptions extends WritableOptions {
+    asyncThreshold?: number;
+    singleCopy?: boolean;
+    batch?: boolean;
+    verify?: 'always' | 'sampled' | 'deferred' | 'off';
+    verifyInterval?: number;
+    ring?: boolean | number;
+}
 
 declare class EncoderStream extends Writable {
+    granuleRate: number;
+    granuleTime(granulepos: bigint): number;
     packetin(chunk: any, callback?: (error: Error | null | undefined) => void): boolean;
     packetin(chunk: any, encoding: BufferEncoding, callback?: (error: Error | null | undefined) => void): boolean;
     pageout(callback?: (error: Error | null | undefined) => void): boolean;
     flush(callback?: (error: Error | null | undefined) => void): boolean;
+    eos(callback?: (error: Error | null | undefined) => void): boolean;
+    mux(packets: ogg_packet[] | PacketBatch, callback?: (error: Error | null | undefined) => void): boolean;
+    mux(packets: ogg_packet[] | PacketBatch, flush: boolean, callback?: (error: Error | null | undefined) => void): boolean;
 }
 
 export class Encoder extends Readable implements NodeJS.ReadableStream {
-    stream: (serialno:number|undefined) => EncoderStream
+    constructor(opts?: EncoderOptions);
+    stream: (serialno:number|undefined, opts?: EncoderStreamOptions) => EncoderStream
+    readInto(arena: Uint8Array, offset?: number): number;
+    use(stream: OpusEncoder): this;
+}
+
+export interface OpusEncoderOptions {
+    pageDuration?: number;
+    pageBytes?: number;
+    zeroDelay?: boolean;
+}
+
+/** Reads out `ogg_packet` instances; with `zeroDelay` the last object read is the `{ eos: true }` command instead. */
+export class OpusEncoder extends Transform {
+    constructor(rate?: number, channels?: number, frameSize?: number, opts?: OpusEncoderOptions);
+    streamOptions: EncoderStreamOptions;
 }
 
 type PacketEventType = "packet";
@@ -17,7 +62,7 @@ type EosEventType = "eos";
 
 declare class DecoderStream extends Readable {
     // @ts-ignore
-    on(name: PacketEventType, handler : (packet:ogg_packet) => void):this;
+    on(name: PacketEventType, handler : (packet:ogg_packet|PacketBatch) => void):this;
     // @ts-ignore
     on(name: PageEventType, handler : (page:any) => void):this;
     // @ts-ignore
@@ -25,11 +70,15 @@ declare class DecoderStream extends Readable {
 }
 
 type StreamEventType = "stream";
+type CorruptEventType = "corrupt";
 
 export class Decoder extends Writable implements NodeJS.WritableStream {
+    constructor(opts?: DecoderOptions);
     stream: (serialno:number|undefined) => DecoderStream
     // @ts-ignore
     on(name: StreamEventType, handler : (stream: DecoderStream) => void):this;
+    // @ts-ignore
+    on(name: CorruptEventType, handler : (offset: number, length: number) => void):this;
 }
 
 export class ogg_packet {
@@ -40,3 +89,54 @@ export class ogg_packet {
     granulepos: number;
     packetno: number;
 }
+
+export interface IovecPacket {
+    packet: Buffer[];
+    e_o_s?: 1|0|boolean;
+    granulepos?: number;
+    flush?: boolean;
+    pageout?: boolean;
+}
+
+export class PacketBatch {
+    constructor(fields: {
+        data: ArrayBuffer;
+        serialno?: Int32Array | null;
+        offsets: Uint32Array;
+        lengths: Uint32Array;
+        b_o_s: Uint8Array;
+        e_o_s: Uint8Array;
+        granulepos: BigInt64Array;
+        packetno: BigInt64Array;
+    });
+    static from(packets: Array<Pick<ogg_packet, 'packet'> & Partial<ogg_packet>>): PacketBatch;
+    data: ArrayBuffer;
+    serialno: Int32Array | null;
+    offsets: Uint32Array;
+    lengths: Uint32Array;
+    b_o_s: Uint8Array;
+    e_o_s: Uint8Array;
+    granulepos: BigInt64Array;
+    packetno: BigInt64Array;
+    readonly length: number;
+    readonly bytes: number;
+    packet(i: number): Buffer;
+    select(serialno: number): PacketBatch;
+    streams(): number[];
+}
+
+export interface PageScan {
+    offsets: Uint32Array;
+    lengths: Uint32Array;
+    serialno: Int32Array;
+    granulepos: BigInt64Array;
+    flags: Uint8Array;
+    crc: Uint8Array;
+    next: number;
+}
+
+/** `buffer` must be smaller than 4 GiB, as `offsets` are 32-bit; larger buffers throw a RangeError. */
+export function scanPages(buffer: Uint8Array, offset?: number): PageScan;
+export function scanPages(buffer: Uint8Array, callback: (error: Error | null, result: PageScan) => void): void;
+export function scanPages(buffer: Uint8Array, offset: number, callback: (error: Error | null, result: PageScan) => void): void;
+export function opusDurations(packets: Array<Uint8Array | ogg_packet> | PacketBatch): Int32Array;
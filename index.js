@@ -1,4 +1,7 @@
 exports.ogg_packet = exports.packet = require('./lib/binding').ogg_packet;
+exports.PacketBatch = require('./lib/packet-batch');
 exports.Decoder = require('./lib/decoder');
 exports.Encoder = require('./lib/encoder');
 exports.OpusEncoder = require('./lib/opus-encoder-stream');
+exports.scanPages = require('./lib/scan-pages');
+exports.opusDurations = require('./lib/opus-durations');
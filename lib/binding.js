@@ -1 +1,40 @@
-module.exports = require('bindings')('ogg');
+var binding = module.exports = require('bindings')('ogg');
+
+/**
+ * Size in bytes at or above which a libogg call is offloaded to the libuv
+ * thread pool. Smaller calls run inline through their `*Sync` variant, since
+ * for a few kilobytes of framing work the thread pool round trip costs more
+ * than the work itself. The `Decoder` and `Encoder` constructors accept an
+ * `asyncThreshold` option to override this per instance; `0` always offloads
+ * and `Infinity` never does.
+ *
+ * @api public
+ */
+
+binding.asyncThreshold = 64 * 1024;
+
+/**
+ * Calls the binding function `name` with `args` and the callback `fn`.
+ *
+ * When `bytes` is below `threshold` the `*Sync` variant is called and `fn` is
+ * invoked synchronously with the same arguments the async worker would have
+ * passed it. Otherwise the call is queued on the thread pool as usual.
+ *
+ * @param {String} name binding function name, i.e. "ogg_sync_write"
+ * @param {Number} bytes amount of data the call is going to touch
+ * @param {Number} threshold defaults to `binding.asyncThreshold`
+ * @param {Array} args arguments to pass to the binding function
+ * @param {Function} fn callback function
+ * @api private
+ */
+
+binding.dispatch = function (name, bytes, threshold, args, fn) {
+  if (null == threshold) threshold = binding.asyncThreshold;
+  if (bytes < threshold) {
+    var rtn = binding[name + 'Sync'].apply(binding, args);
+    if (Array.isArray(rtn)) fn.apply(null, rtn);
+    else fn(rtn);
+  } else {
+    binding[name].apply(binding, args.concat(fn));
+  }
+};
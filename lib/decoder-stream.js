@@ -3,8 +3,7 @@
  */
 
 var debug = require('debug')('ogg:decoder-stream');
-var binding = require('./binding');
-var ogg_packet = require('./binding').ogg_packet;
+var PacketBatch = require('./packet-batch');
 var inherits = require('util').inherits;
 var Readable = require('stream').Readable;
 
@@ -26,12 +25,16 @@ function DecoderStream(serialno) {
   if (!(this instanceof DecoderStream)) return new DecoderStream(serialno);
   Readable.call(this, { objectMode: true, highWaterMark: 0 });
 
-  // array of `ogg_packet` instances to output for the _read() function
-  this.packets = [];
-
   this.serialno = serialno;
 
-  this.os = new binding.ogg_stream_state(serialno);
+  // `ogg_packet` instances (or `PacketBatch`es) to output from _read(), the
+  // index of the next one, and the callback to invoke once all have been read
+  this._queue = null;
+  this._index = 0;
+  this._done = null;
+
+  // whether _read() was called while the queue was empty
+  this._waiting = false;
 }
 inherits(DecoderStream, Readable);
 
@@ -71,116 +74,76 @@ DecoderStream.prototype.removeListener = function (ev, fn) {
 };
 
 /**
- * Calls `ogg_stream_pagein()` on this OggStream.
- * Internal function used by the `Decoder` class.
+ * Queues the packets the native demuxer read out of this stream for one
+ * written chunk. Internal function used by the `Decoder` class.
  *
- * @param {Buffer} page `ogg_page` instance
- * @param {Number} packets the number of `ogg_packet` instances in the page
- * @param {Function} fn callback function
+ * @param {Array} packets `ogg_packet` instances or `PacketBatch`es
+ * @param {Function} fn callback function, invoked once all have been read
  * @api private
  */
 
-DecoderStream.prototype.pagein = function (page, packets, fn) {
-  debug('pagein(%d packets)', packets);
-
-  var os = this.os;
-  var self = this;
-  var packet;
+DecoderStream.prototype.enqueue = function (packets, fn) {
+  debug('enqueue(%d packets)', packets.length);
+  if (0 === packets.length) return fn();
 
-  binding.ogg_stream_pagein(os, page, afterPagein);
-  function afterPagein(r) {
-    if (0 === r) {
-      // `ogg_page` has been submitted, now emit a "page" event
-      self.emit('page', page);
-
-      // now read out the packets and push them onto this Readable stream
-      packetout();
-    } else {
-      fn(new Error('ogg_stream_pagein() error: ' + r));
-    }
+  var first = packets[0];
+  if (first instanceof PacketBatch ? first.b_o_s[0] : first.b_o_s) {
+    this.emit('bos');
   }
+  this._queue = packets;
+  this._index = 0;
+  this._done = fn;
 
-  function packetout() {
-    debug('packetout(), %d packets left', packets);
-    if (0 === packets) {
-      // no more packets to read out, we're done...
-      fn();
-    } else {
-      packet = new ogg_packet();
-      binding.ogg_stream_packetout(os, packet, afterPacketout);
-    }
+  if (this._waiting) {
+    this._waiting = false;
+    this._pushNext();
   }
+};
 
-  function afterPacketout(rtn, bytes, b_o_s, e_o_s, granulepos, packetno) {
-    debug(
-      'afterPacketout(%d, %d, %d, %d, %d, %d)',
-      rtn,
-      bytes,
-      b_o_s,
-      e_o_s,
-      granulepos,
-      packetno
-    );
-    if (1 === rtn) {
-      // got a packet...
-
-      // since libogg takes control of the `packet`s "packet" data field, we must
-      // copy it over to a Node.js buffer and change the pointer over. That way,
-      // the `packet` Buffer is *completely* managed by the JS garbage collector
-      var p = Buffer.from(packet.packet);
-      packet.packet = p;
-
-      if (b_o_s) {
-        self.emit('bos');
-      }
-      packet._callback = afterPacketRead;
-      self.packets.push(packet);
-      self.emit('_packet');
-    } else if (-1 === rtn) {
-      // libogg issued a sync warning, usually recoverable, try it again.
-      // http://xiph.org/ogg/doc/libogg/ogg_stream_packetout.html
-      packetout();
-    } else {
-      // libogg returned an unrecoverable error
-      fn(new Error('ogg_stream_packetout() error: ' + rtn));
-    }
-  }
+/**
+ * Pushes the next queued packet, otherwise waits for `enqueue()`.
+ *
+ * @api private
+ */
 
-  function afterPacketRead(err) {
-    debug('afterPacketRead(%s)', err);
-    if (err) return fn(err);
-    if (packet.e_o_s) {
-      self.emit('eos');
-      self.push(null); // emit "end"
-    }
-    --packets;
-    // read out the next packet from the stream
-    packetout();
+DecoderStream.prototype._read = function () {
+  debug('_read()');
+  if (this._queue) {
+    this._pushNext();
+  } else {
+    this._waiting = true;
   }
 };
 
 /**
- * Pushes the next "packet" from the "packets" array, otherwise waits for an
- * "_packet" event.
+ * Pushes the next packet of the queue. Once the queue is drained the
+ * `enqueue()` callback is invoked on the next tick.
  *
  * @api private
  */
 
-DecoderStream.prototype._read = function (n, fn) {
-  debug('_read(%d packets)', n);
-  function onpacket() {
-    var packet = this.packets.shift();
-    var callback = packet._callback;
-    packet._callback = null;
-
-    if (this.push) this.push(packet);
-    else fn(null, packet); // XXX: old Readable API, remove at some point
-
-    if (callback) process.nextTick(callback);
+DecoderStream.prototype._pushNext = function () {
+  var packet = this._queue[this._index++];
+  var fn = null;
+  if (this._index === this._queue.length) {
+    fn = this._done;
+    this._queue = null;
+    this._done = null;
   }
-  if (this.packets.length > 0) {
-    onpacket.call(this);
-  } else {
-    this.once('_packet', onpacket);
+
+  var e_o_s = packet instanceof PacketBatch ?
+    packet.e_o_s[packet.length - 1] : packet.e_o_s;
+  this.push(packet);
+  if (e_o_s) {
+    this.emit('eos');
+    this.push(null); // emit "end"
+    // nothing more can be read, don't hold up the Decoder
+    if (this._queue) {
+      fn = this._done;
+      this._queue = null;
+      this._done = null;
+    }
   }
+
+  if (fn) process.nextTick(fn);
 };
@@ -7,6 +7,7 @@ var binding = require('./binding');
 var inherits = require('util').inherits;
 var Writable = require('stream').Writable;
 var DecoderStream = require('./decoder-stream');
+var PacketBatch = require('./packet-batch');
 
 /**
  * Module exports.
@@ -20,6 +21,36 @@ module.exports = Decoder;
  * "packet" events with the raw `ogg_packet` instance to send to an ogg stream
  * decoder (like Vorbis, Theora, etc.).
  *
+ * Besides the regular Writable stream options, `opts.asyncThreshold` sets the
+ * chunk size in bytes at or above which libogg work is done on the thread pool
+ * rather than inline (defaults to `binding.asyncThreshold`).
+ *
+ * With `opts.singleCopy` set, every chunk is copied exactly once, into memory
+ * owned by the emitted packets: packets that fit within a page are Buffer
+ * views into it, and only packets spanning pages are reassembled. The memory
+ * of a chunk is released once all of its packets have been garbage collected,
+ * so don't hold on to a few small packets for long in this mode.
+ *
+ * With `opts.batch` set, DecoderStreams emit `PacketBatch` instances, each
+ * holding all of the stream's packets from one written chunk, instead of one
+ * `ogg_packet` per "packet" event. No "page" events are emitted in this mode.
+ *
+ * With `opts.ring` set (`true`, or a size in bytes), the native sync buffer is
+ * a ring mapped twice in memory where the platform supports it (Linux), so the
+ * unread tail of the input is never moved to make room for the next chunk.
+ * Has no effect with `opts.singleCopy`. Elsewhere, or if the mapping fails,
+ * it quietly falls back to the plain buffer; `_decoder.ring` tells which.
+ *
+ * `opts.verify` selects how page checksums are checked: "always" (default)
+ * verifies every page before it is demuxed, "sampled" only every
+ * `opts.verifyInterval`th page (defaults to 16), and "off" none at all. With
+ * "deferred" pages are demuxed unchecked while the checksums are verified on
+ * the thread pool behind the demuxer; a "corrupt" event with the `offset` and
+ * `length` of the input that failed to verify is emitted for each bad stretch,
+ * and "finish" is held back until the whole input has been checked. Pages
+ * with bad checksums are only dropped in the "always" mode, and in "sampled"
+ * mode when they happen to be checked.
+ *
  * @param {Object} opts Writable stream options
  * @api public
  */
@@ -28,13 +59,42 @@ function Decoder(opts) {
   if (!(this instanceof Decoder)) return new Decoder(opts);
   Writable.call(this, opts);
 
-  this.oy = new binding.ogg_sync_state();
+  this.asyncThreshold = opts && null != opts.asyncThreshold ?
+    opts.asyncThreshold : binding.asyncThreshold;
+
+  this.singleCopy = Boolean(opts && opts.singleCopy);
+
+  this.batch = Boolean(opts && opts.batch);
+
+  this.verify = opts && opts.verify || 'always';
+
+  // owns the `ogg_sync_state` and every `ogg_stream_state`
+  this._decoder = new binding.ogg_decoder({
+    singleCopy: this.singleCopy,
+    batch: this.batch,
+    verify: this.verify,
+    verifyInterval: opts && opts.verifyInterval,
+    ring: opts && opts.ring
+  });
+
+  // chunks waiting for the deferred checksum pass, which runs one at a time
+  this._unverified = [];
+  this._verifying = false;
+  this._onverified = null;
 }
 inherits(Decoder, Writable);
 
 /**
  * Writable stream base class `_write()` callback function.
  *
+ * The whole sync/pagein/packetout loop for the chunk runs natively, which
+ * hands back every page of the chunk in input order, and its packets grouped
+ * by stream. The "page" events are emitted first, as for a page-at-a-time
+ * demuxer: the Decoder's, then "stream" if the page starts a new stream, then
+ * the DecoderStream's. Each DecoderStream then gets its packets in one go,
+ * and the next group is handed out once the previous stream's packets have
+ * all been read, so that slow readers still apply backpressure.
+ *
  * @param {Buffer} chunk
  * @param {Function} done
  * @api private
@@ -46,57 +106,112 @@ Decoder.prototype._write = function(chunk, encoding, done) {
   // XXX: compat for old Writable API... remove at some point...
   if ('function' == typeof encoding) done = encoding;
 
-  // allocate space for 1 `ogg_page`
-  // XXX: we could do this at the per-decoder level, since only 1 ogg_page is
-  // active (being processed by an ogg decoder) at a time
-  var stream;
   var self = this;
-  var oy = this.oy;
-  var page = new binding.ogg_page();
-
-  binding.ogg_sync_write(oy, chunk, afterWrite);
-  function afterWrite(rtn) {
-    debug('after _write(%d)', rtn);
-    if (0 === rtn) {
-      pageout();
-    } else {
-      done(new Error('ogg_sync_write() error: ' + rtn));
-    }
-  }
+  var groups;
+  var i = 0;
+
+  if (this.verify === 'deferred') this._verifyLater(chunk);
 
-  function pageout() {
-    debug('pageout()');
-    page.serialno = null;
-    page.packets = null;
-    binding.ogg_sync_pageout(oy, page, afterPageout);
+  if (chunk.length < this.asyncThreshold) {
+    var rtn = this._decoder.writeSync(chunk);
+    afterDemux(rtn[0], rtn[1]);
+  } else {
+    this._decoder.write(chunk, afterDemux);
   }
 
-  function afterPageout(rtn, serialno, packets) {
-    debug('afterPageout(%d, %d, %d)', rtn, serialno, packets);
-    if (1 === rtn) {
-      // got a page, now write it to the appropriate DecoderStream
-      page.serialno = serialno;
-      page.packets = packets;
+  function afterDemux(err, rtn) {
+    debug('afterDemux(%s, %d pages, %d streams)', err,
+      rtn && rtn.pages.length, rtn && rtn.groups.length);
+    if (err) return done(err);
+    for (var j = 0; j < rtn.pages.length; j++) {
+      var page = rtn.pages[j];
       self.emit('page', page);
-      stream = self._stream(serialno);
-      stream.pagein(page, packets, afterPagein);
-    } else if (0 === rtn) {
-      // need more data
-      done();
-    } else {
-      // something bad...
-      done(new Error('ogg_sync_pageout() error: ' + rtn));
+      self._stream(page.serialno).emit('page', page);
     }
+    groups = rtn.groups;
+    next();
   }
 
-  function afterPagein(err) {
-    debug('afterPagein(%s)', err);
+  function next(err) {
     if (err) return done(err);
-    // attempt to read out the next page from the `ogg_sync_state`
-    pageout();
+    if (i >= groups.length) return done();
+    var group = groups[i++];
+    var stream = self._stream(group.serialno);
+    var packets = group.packets;
+    if (self.batch) packets = [ new PacketBatch(packets) ];
+    stream.enqueue(packets, next);
   }
 };
 
+/**
+ * Writable stream base class `_final()` callback function. Holds back "finish"
+ * until the deferred checksum pass has caught up.
+ *
+ * @param {Function} done
+ * @api private
+ */
+
+Decoder.prototype._final = function(done) {
+  if (!this._verifying) return done();
+  debug('_final(%d chunks left to verify)', this._unverified.length);
+  this._onverified = done;
+};
+
+/**
+ * Queues a copy of `chunk` for the deferred checksum pass. It is only read
+ * after `_write()` has called back, by which time the writer may be reusing
+ * the memory.
+ *
+ * @param {Buffer} chunk
+ * @api private
+ */
+
+Decoder.prototype._verifyLater = function(chunk) {
+  this._unverified.push(Buffer.from(chunk));
+  if (!this._verifying) this._verifyNext();
+};
+
+/**
+ * Verifies the next queued chunk on the thread pool, emitting a "corrupt"
+ * event for each stretch of input that failed.
+ *
+ * @api private
+ */
+
+Decoder.prototype._verifyNext = function() {
+  var self = this;
+  var chunk = this._unverified.shift();
+  if (!chunk) return this._verified(null);
+
+  this._verifying = true;
+  this._decoder.verify(chunk, function(err, ranges) {
+    if (err) return self._verified(err);
+    for (var i = 0; i < ranges.length; i += 2) {
+      debug('corrupt(%d, %d)', ranges[i], ranges[i + 1]);
+      self.emit('corrupt', ranges[i], ranges[i + 1]);
+    }
+    self._verifyNext();
+  });
+};
+
+/**
+ * Called when the deferred checksum pass has caught up, or failed with `err`,
+ * in which case the chunks still queued are dropped. Lets a pending _final()
+ * call back, with `err` if any.
+ *
+ * @param {Error} err
+ * @api private
+ */
+
+Decoder.prototype._verified = function(err) {
+  this._verifying = false;
+  if (err) this._unverified = [];
+  var done = this._onverified;
+  this._onverified = null;
+  if (done) done(err);
+  else if (err) this.emit('error', err);
+};
+
 /**
  * Gets an DecoderStream instance for the given "serialno".
  * Creates one if necessary, and then emits a "stream" event.
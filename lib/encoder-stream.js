@@ -4,6 +4,8 @@
 
 var debug = require('debug')('ogg:encoder-stream');
 var binding = require('./binding');
+var PacketBatch = require('./packet-batch');
+var TimerWheel = require('./timer-wheel');
 var inherits = require('util').inherits;
 var Writable = require('stream').Writable;
 
@@ -17,17 +19,54 @@ function randomInt(high) {
   return Math.floor(Math.random() * high);
 }
 
+function isPacket(packet) {
+  return packet instanceof binding.ogg_packet;
+}
+
+function isPieced(packet) {
+  return Boolean(packet) && Array.isArray(packet.packet);
+}
+
 /**
  * The `EncoderStream` class abstracts the `ogg_stream` data structure when
  * used with the encoding interface. You should not need to create instances of
  * `EncoderStream` manually, instead, instances are returned from the
  * `Encoder#stream()` function.
  *
+ * `opts.asyncThreshold` is the byte size at or above which libogg calls are
+ * offloaded to the thread pool (defaults to `binding.asyncThreshold`).
+ * `opts.granuleRate` and `opts.granuleTime` override `granuleTime()`.
+ *
+ * With `opts.zeroCopy` set, `mux()` hands packet payloads to libogg by
+ * reference: they are copied once, straight into the pages, instead of into
+ * the stream first. Packets left over for a later page are kept alive until
+ * then, and their payloads must not be modified until they have been paged
+ * out. Don't mix `mux()` with `packetin()` on such a stream.
+ *
+ * Besides `ogg_packet` instances and `PacketBatch`es, `packetin()` takes
+ * packets assembled from several pieces: plain objects whose `packet` is an
+ * Array of Buffers (with optional `e_o_s`, `granulepos` and command
+ * properties), or an Array of such objects. The pieces are gathered straight
+ * into the stream by `ogg_stream_iovecin()`, so they never need to be
+ * concatenated first.
+ *
+ * `opts.pageBytes` sets the nominal page size (defaults to libogg's 4096
+ * bytes): small values such as a network MTU make for low latency, large ones
+ * for less page header overhead. libogg still puts at least four packets on
+ * a page unless it is flushed. `opts.pageDuration` bounds page latency
+ * instead, in granulepos units: once the packets waiting to be paged out
+ * reach that far past the previous page, they are flushed.
+ *
+ * `opts.flushDeadline` bounds latency in wall clock time: packet data left
+ * waiting for a page for that many milliseconds is flushed, however quiet the
+ * stream. The deadlines of all streams run off `opts.timers`, a shared
+ * `TimerWheel` by default, rather than a timer each.
+ *
  * @api private
  */
 
-function EncoderStream(serialno) {
-  if (!(this instanceof EncoderStream)) return new EncoderStream(serialno);
+function EncoderStream(serialno, opts) {
+  if (!(this instanceof EncoderStream)) return new EncoderStream(serialno, opts);
   Writable.call(this, { objectMode: true, highWaterMark: 0 });
 
   if (null == serialno) {
@@ -37,9 +76,51 @@ function EncoderStream(serialno) {
   }
   this.serialno = serialno;
   this.os = new binding.ogg_stream_state(serialno);
+
+  this.asyncThreshold = opts && null != opts.asyncThreshold ?
+    opts.asyncThreshold : binding.asyncThreshold;
+
+  // number of packet bytes submitted since the last pageout/flush, used to
+  // decide whether the next pageout/flush is worth a thread pool hop
+  this._buffered = 0;
+
+  this.zeroCopy = Boolean(opts && opts.zeroCopy);
+
+  this.pageBytes = opts && null != opts.pageBytes ? opts.pageBytes : null;
+  this.pageDuration = opts && null != opts.pageDuration ?
+    opts.pageDuration : null;
+
+  // latest packet granulepos submitted, and the granulepos of the last page
+  // written, for `pageDuration`
+  this._granulepos = -1;
+  this._pageGranulepos = -1;
+
+  this.flushDeadline = opts && null != opts.flushDeadline ?
+    opts.flushDeadline : null;
+  if (null != this.flushDeadline) {
+    this._timers = opts.timers || TimerWheel.shared();
+    this._timer = { fn: this._expire.bind(this) };
+  }
+
+  this.granuleRate = opts && opts.granuleRate || 1;
+  if (opts && opts.granuleTime) this.granuleTime = opts.granuleTime;
 }
 inherits(EncoderStream, Writable);
 
+/**
+ * Maps a page granulepos (a BigInt) to a presentation time in seconds, for
+ * the `Encoder`'s interleaver. The default assumes a codec whose granulepos
+ * counts samples at `granuleRate`, like Vorbis or Opus.
+ *
+ * @param {BigInt} granulepos
+ * @return {Number} seconds
+ * @api public
+ */
+
+EncoderStream.prototype.granuleTime = function(granulepos) {
+  return Number(granulepos) / this.granuleRate;
+};
+
 EncoderStream.prototype.packetin = EncoderStream.prototype.write;
 
 /**
@@ -66,6 +147,41 @@ EncoderStream.prototype.flush = function(fn) {
   return this.write.call(this, { flush: true }, fn);
 };
 
+/**
+ * Ends the stream after its last packet went in without `e_o_s` set, and
+ * flushes. The final page carries the "eos" flag; if no packets are left
+ * for it, it is an empty page with the granulepos of the last packet.
+ *
+ * @param {Function} fn callback function
+ * @api public
+ */
+
+EncoderStream.prototype.eos = function(fn) {
+  debug('eos()');
+  return this.write.call(this, { eos: true }, fn);
+};
+
+/**
+ * Submits an Array of `ogg_packet` instances, or a `PacketBatch`, and then
+ * pages out (or, with `flush` set, flushes) everything that is ready, all in
+ * a single native call. The resulting pages are emitted as one "pages" event
+ * with all of their bytes in a single Buffer.
+ *
+ * @param {Array|PacketBatch} packets
+ * @param {Boolean} flush whether to call `ogg_stream_flush()` (optional)
+ * @param {Function} fn callback function
+ * @api public
+ */
+
+EncoderStream.prototype.mux = function(packets, flush, fn) {
+  debug('mux(%d packets)', packets.length);
+  if ('function' == typeof flush) {
+    fn = flush;
+    flush = false;
+  }
+  return this.write.call(this, { mux: packets, flush: Boolean(flush) }, fn);
+};
+
 /**
  * Writable stream _write() callback function.
  * Takes the given `ogg_packet` and calls `ogg_stream_packetin()` on it.
@@ -83,16 +199,34 @@ EncoderStream.prototype._write = function(packet, encoding, fn) {
   if ('function' == typeof encoding) fn = encoding;
 
   var self = this;
+  if (packet.mux) {
+    return this._mux(packet.mux, packet.flush, fn);
+  }
   if (packet instanceof binding.ogg_packet) {
     // assumed to be an `ogg_packet` Buffer instance
     this._packetin(packet, checkCommand);
+  } else if (packet instanceof PacketBatch) {
+    this._packetinBatch(packet, checkCommand);
+  } else if (Array.isArray(packet)) {
+    if (packet.every(isPacket)) {
+      this._packetinEach(packet, checkCommand);
+    } else if (packet.every(isPieced)) {
+      this._iovecinBatch(packet, checkCommand);
+    } else {
+      fn(new TypeError('an Array of packets must hold either `ogg_packet` ' +
+        'instances or packets in pieces, not both or anything else'));
+    }
+  } else if (Array.isArray(packet.packet)) {
+    this._iovecin(packet, checkCommand);
   } else {
     checkCommand();
   }
   function checkCommand(err) {
     if (err) return fn(err);
-    debug('checking if "packet" contains a "pageout"/"flush" command');
-    if (packet.flush) {
+    debug('checking if "packet" contains a "pageout"/"flush"/"eos" command');
+    if (packet.eos) {
+      self._eos(fn);
+    } else if (packet.flush) {
       self._flush(fn);
     } else if (packet.pageout) {
       self._pageout(fn);
@@ -111,7 +245,11 @@ EncoderStream.prototype._write = function(packet, encoding, fn) {
 
 EncoderStream.prototype._packetin = function(packet, fn) {
   debug('_packetin()');
-  binding.ogg_stream_packetin(this.os, packet, function(rtn) {
+  var bytes = packet.bytes;
+  this._buffered += bytes;
+  this._granule(packet.granulepos);
+  this._age();
+  binding.dispatch('ogg_stream_packetin', bytes, this.asyncThreshold, [ this.os, packet ], function(rtn) {
     debug('ogg_stream_packetin() return = %d', rtn);
     if (0 === rtn) {
       fn();
@@ -121,6 +259,226 @@ EncoderStream.prototype._packetin = function(packet, fn) {
   });
 };
 
+/**
+ * Calls `ogg_stream_packetin()` for each of an Array of `ogg_packet`
+ * instances, one after the other.
+ *
+ * @api private
+ */
+
+EncoderStream.prototype._packetinEach = function(packets, fn) {
+  debug('_packetinEach(%d packets)', packets.length);
+  var self = this;
+  (function next(i, err) {
+    if (err || i === packets.length) return fn(err);
+    self._packetin(packets[i], function(err) {
+      next(i + 1, err);
+    });
+  })(0);
+};
+
+/**
+ * Calls `ogg_stream_packetin()` for every packet of a `PacketBatch`.
+ *
+ * @api private
+ */
+
+EncoderStream.prototype._packetinBatch = function(batch, fn) {
+  debug('_packetinBatch(%d packets)', batch.length);
+  var bytes = batch.bytes;
+  this._buffered += bytes;
+  for (var i = 0; i < batch.length; i++) this._granule(batch.granulepos[i]);
+  this._age();
+  binding.dispatch('ogg_stream_packetin_batch', bytes, this.asyncThreshold, [ this.os, batch ], function(rtn) {
+    debug('ogg_stream_packetin_batch() return = %d', rtn);
+    if (0 === rtn) {
+      fn();
+    } else {
+      fn(new Error(rtn));
+    }
+  });
+};
+
+/**
+ * Calls `ogg_stream_iovecin()` with the pieces of a packet.
+ *
+ * @api private
+ */
+
+EncoderStream.prototype._iovecin = function(packet, fn) {
+  debug('_iovecin(%d pieces)', packet.packet.length);
+  var bytes = 0;
+  for (var i = 0; i < packet.packet.length; i++) bytes += packet.packet[i].length;
+  this._buffered += bytes;
+  this._granule(packet.granulepos);
+  this._age();
+  var args = [ this.os, packet.packet, Boolean(packet.e_o_s), packet.granulepos || 0 ];
+  binding.dispatch('ogg_stream_iovecin', bytes, this.asyncThreshold, args, function(rtn) {
+    debug('ogg_stream_iovecin() return = %d', rtn);
+    if (0 === rtn) {
+      fn();
+    } else {
+      fn(new Error(rtn));
+    }
+  });
+};
+
+/**
+ * Calls `ogg_stream_iovecin()` for each of an Array of pieced packets.
+ *
+ * @api private
+ */
+
+EncoderStream.prototype._iovecinBatch = function(packets, fn) {
+  debug('_iovecinBatch(%d packets)', packets.length);
+  var bytes = 0;
+  for (var i = 0; i < packets.length; i++) {
+    for (var j = 0; j < packets[i].packet.length; j++) bytes += packets[i].packet[j].length;
+    this._granule(packets[i].granulepos);
+  }
+  this._buffered += bytes;
+  this._age();
+  binding.dispatch('ogg_stream_iovecin_batch', bytes, this.asyncThreshold, [ this.os, packets ], function(rtn) {
+    debug('ogg_stream_iovecin_batch() return = %d', rtn);
+    if (0 === rtn) {
+      fn();
+    } else {
+      fn(new Error(rtn));
+    }
+  });
+};
+
+/**
+ * Calls `ogg_stream_mux()`.
+ *
+ * @api private
+ */
+
+EncoderStream.prototype._mux = function(packets, flush, fn) {
+  debug('_mux(%d packets, flush=%s)', packets.length, flush);
+  var self = this;
+  var bytes = this._buffered;
+  var i;
+  if (packets instanceof PacketBatch) {
+    bytes += packets.bytes;
+    for (i = 0; i < packets.length; i++) this._granule(packets.granulepos[i]);
+  } else {
+    for (i = 0; i < packets.length; i++) {
+      bytes += packets[i].bytes;
+      this._granule(packets[i].granulepos);
+    }
+  }
+  flush = flush || this._overdue();
+  binding.dispatch('ogg_stream_mux', bytes, this.asyncThreshold, [ this.os, packets, flush, this.zeroCopy, this.pageBytes ], function(rtn, data, lengths, granulepos, e_o_s) {
+    debug('ogg_stream_mux() return = %d (%d pages)', rtn, lengths && lengths.length);
+    if (0 !== rtn) return fn(new Error(rtn));
+    for (var i = 0; i < granulepos.length; i++) self._paged(granulepos[i]);
+    // only page bodies came out of the buffered bytes, not the headers
+    var body = 0;
+    for (var offset = 0, j = 0; j < lengths.length; offset += lengths[j++]) {
+      body += lengths[j] - 27 - data[offset + 26];
+    }
+    self._buffered = flush ? 0 : Math.max(0, bytes - body);
+    self._age();
+    if (lengths.length > 0) {
+      self.emit('pages', self, data, lengths, granulepos, e_o_s);
+    }
+    fn();
+  });
+};
+
+/**
+ * Calls `ogg_stream_end()`, then flushes.
+ *
+ * @api private
+ */
+
+EncoderStream.prototype._eos = function(fn) {
+  debug('_eos()');
+  var rtn = binding.ogg_stream_end(this.os);
+  debug('ogg_stream_end() return = %d', rtn);
+  if (0 !== rtn) return fn(new Error(rtn));
+  this._flush(fn);
+};
+
+/**
+ * Returns the binding function name and arguments for a pageout or flush of
+ * `og`, using the `*_fill` variant when `pageBytes` is set.
+ *
+ * @api private
+ */
+
+EncoderStream.prototype._pageCall = function(name, og) {
+  if (null == this.pageBytes) return { name: name, args: [ this.os, og ] };
+  return { name: name + '_fill', args: [ this.os, og, this.pageBytes ] };
+};
+
+/**
+ * Records the granulepos of a submitted packet.
+ *
+ * @param {Number|BigInt} granulepos
+ * @api private
+ */
+
+EncoderStream.prototype._granule = function(granulepos) {
+  granulepos = Number(granulepos);
+  if (granulepos > this._granulepos) this._granulepos = granulepos;
+};
+
+/**
+ * Records the granulepos of a page written out. Pages on which no packet
+ * ends have a granulepos of -1 and don't count.
+ *
+ * @param {Number|BigInt} granulepos
+ * @api private
+ */
+
+EncoderStream.prototype._paged = function(granulepos) {
+  granulepos = Number(granulepos);
+  if (granulepos !== -1) this._pageGranulepos = granulepos;
+};
+
+/**
+ * Returns whether the packets waiting to be paged out have reached
+ * `pageDuration` past the last page, and should be flushed.
+ *
+ * @api private
+ */
+
+EncoderStream.prototype._overdue = function() {
+  if (null == this.pageDuration || this._pageGranulepos === -1) return false;
+  return this._granulepos - this._pageGranulepos >= this.pageDuration;
+};
+
+/**
+ * Starts the `flushDeadline` clock when packet data starts waiting for a
+ * page, and stops it once none is left. Data left over after a page keeps
+ * the deadline of the oldest data, so it may be flushed a little early.
+ *
+ * @api private
+ */
+
+EncoderStream.prototype._age = function() {
+  if (null == this.flushDeadline) return;
+  if (this._buffered === 0) {
+    this._timers.remove(this._timer);
+  } else if (!this._timers.has(this._timer)) {
+    this._timers.add(this._timer, this.flushDeadline);
+  }
+};
+
+/**
+ * Called by the timer wheel when data has waited for `flushDeadline`.
+ *
+ * @api private
+ */
+
+EncoderStream.prototype._expire = function() {
+  if (this._writableState.ending) return;
+  debug('flush deadline passed (%d bytes waiting)', this._buffered);
+  this.flush();
+};
+
 /**
  * Calls `ogg_stream_pageout()` repeatedly until it returns 0.
  *
@@ -129,12 +487,15 @@ EncoderStream.prototype._packetin = function(packet, fn) {
 
 EncoderStream.prototype._pageout = function(fn) {
   debug('_pageout()');
-  var os = this.os;
+  if (this._overdue()) return this._flush(fn);
   var og = new binding.ogg_page(); //new Buffer(binding.sizeof_ogg_page);
   var self = this;
-  binding.ogg_stream_pageout(os, og, function(rtn, hlen, blen, e_o_s) {
+  var bytes = this._buffered;
+  var call = this._pageCall('ogg_stream_pageout', og);
+  binding.dispatch(call.name, bytes, this.asyncThreshold, call.args, function(rtn, hlen, blen, e_o_s) {
     debug(
-      'ogg_stream_pageout() return = %d (hlen=%s) (blen=%s) (eos=%s)',
+      '%s() return = %d (hlen=%s) (blen=%s) (eos=%s)',
+      call.name,
       rtn,
       hlen,
       blen,
@@ -143,6 +504,9 @@ EncoderStream.prototype._pageout = function(fn) {
     if (0 === rtn) {
       fn();
     } else {
+      self._buffered = Math.max(0, self._buffered - blen);
+      self._paged(og.header.readBigInt64LE(6));
+      self._age();
       self.emit('page', self, og, hlen, blen, e_o_s);
       self._pageout(fn);
     }
@@ -157,20 +521,28 @@ EncoderStream.prototype._pageout = function(fn) {
 
 EncoderStream.prototype._flush = function(fn) {
   debug('_flush()');
-  var os = this.os;
   var og = new binding.ogg_page();
   var self = this;
-  binding.ogg_stream_flush(os, og, function(rtn, hlen, blen, e_o_s) {
+  var bytes = this._buffered;
+  var call = this._pageCall('ogg_stream_flush', og);
+  binding.dispatch(call.name, bytes, this.asyncThreshold, call.args, function(rtn, hlen, blen, e_o_s) {
     debug(
-      'ogg_stream_flush() return = %d (hlen=%s) (blen=%s) (eos=%s)',
+      '%s() return = %d (hlen=%s) (blen=%s) (eos=%s)',
+      call.name,
       rtn,
       hlen,
       blen,
       e_o_s
     );
     if (0 === rtn) {
+      // nothing is left waiting for a page
+      self._buffered = 0;
+      self._age();
       fn();
     } else {
+      self._buffered = Math.max(0, self._buffered - blen);
+      self._paged(og.header.readBigInt64LE(6));
+      self._age();
       self.emit('page', self, og, hlen, blen, e_o_s);
       self._flush(fn);
     }
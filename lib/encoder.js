@@ -2,8 +2,11 @@
  * Module dependencies.
  */
 
+var assert = require('assert');
 var debug = require('debug')('ogg:encoder');
+var binding = require('./binding');
 var EncoderStream = require('./encoder-stream');
+var Interleaver = require('./interleaver');
 var inherits = require('util').inherits;
 var Readable = require('stream').Readable;
 
@@ -16,6 +19,28 @@ module.exports = Encoder;
 /**
  * The `Encoder` class.
  * Welds one or more `EncoderStream` instances into a single bitstream.
+ *
+ * Besides the regular Readable stream options, `opts.asyncThreshold` is passed
+ * along to every `EncoderStream` created by this instance.
+ *
+ * With `opts.interleave` set, pages are written in presentation order across
+ * streams, as derived from their granulepos (see the `granuleRate` and
+ * `granuleTime` options of `Encoder#stream()`), rather than in the order the
+ * streams produce them. A page is held back until every other stream has
+ * caught up with it, but for no more than `opts.maxInterleaveDelay` seconds
+ * of media time (defaults to 1), and no stream buffers more than
+ * `opts.maxInterleavePages` pages (defaults to 256).
+ *
+ * With `opts.flushDeadline` set (milliseconds), a stream's packets are
+ * flushed once they have waited that long for a page, so quiet live streams
+ * don't hold on to partial pages. All Encoders share one timer wheel for
+ * these deadlines.
+ *
+ * Pages are read out as they were produced, one Buffer per page (or per
+ * `EncoderStream#mux()` call), never concatenated into larger chunks, so a
+ * piped-to socket or file stream can hand them to `_writev()` as they are.
+ * `readInto()` copies them into a caller-supplied buffer instead. The pages
+ * aren't handed out as lists of separate header and body chunks.
  */
 
 function Encoder(opts) {
@@ -23,6 +48,12 @@ function Encoder(opts) {
   debug('creating new ogg "Encoder" instance');
   Readable.call(this, opts);
 
+  this.asyncThreshold = opts && null != opts.asyncThreshold ?
+    opts.asyncThreshold : binding.asyncThreshold;
+
+  this.flushDeadline = opts && null != opts.flushDeadline ?
+    opts.flushDeadline : null;
+
   // map of `EncoderStream` instances keyed by their serial number
   this.streams = {};
 
@@ -34,6 +65,15 @@ function Encoder(opts) {
   // binded _onpage() call so that we can use it as an event
   // callback function on EncoderStream instances
   this._onpage = this._onpage.bind(this);
+  this._onpages = this._onpages.bind(this);
+
+  this._interleaver = null;
+  if (opts && opts.interleave) {
+    this._interleaver = new Interleaver({
+      maxDelay: opts.maxInterleaveDelay,
+      maxPages: opts.maxInterleavePages
+    });
+  }
 }
 inherits(Encoder, Readable);
 
@@ -41,25 +81,42 @@ inherits(Encoder, Readable);
  * Creates a new EncoderStream instance and returns it for the user to begin
  * submitting `ogg_packet` instances to it.
  *
+ * `opts.granuleRate` (granules per second) or `opts.granuleTime` (a function
+ * mapping a BigInt granulepos to seconds) tell the interleaver how to place
+ * the stream's pages in time. `opts.zeroCopy`, `opts.pageBytes` and
+ * `opts.pageDuration` are passed on to the EncoderStream.
+ *
  * @param {Number} serialno The serial number of the stream, null/undefined means random.
+ * @param {Object} opts EncoderStream options (optional)
  * @return {EncoderStream} The newly created EncoderStream instance. Call `.packetin()` on it.
  * @api public
  */
 
-Encoder.prototype.stream = function(serialno) {
+Encoder.prototype.stream = function(serialno, opts) {
   debug('stream(%d)', serialno);
   var s = this.streams[serialno];
   if (!s) {
-    s = new EncoderStream(serialno);
+    s = new EncoderStream(serialno, {
+      asyncThreshold: this.asyncThreshold,
+      flushDeadline: this.flushDeadline,
+      granuleRate: opts && opts.granuleRate,
+      granuleTime: opts && opts.granuleTime,
+      zeroCopy: opts && opts.zeroCopy,
+      pageBytes: opts && opts.pageBytes,
+      pageDuration: opts && opts.pageDuration
+    });
     s.on('page', this._onpage);
+    s.on('pages', this._onpages);
     this.streams[s.serialno] = s;
+    if (this._interleaver) this._interleaver.add(s);
   }
   return s;
 };
 
 /**
  * Convenience function to attach an Ogg stream encoder to this Ogg encoder
- * instance.
+ * instance. A `streamOptions` property on `stream` (like the `OpusEncoder`'s)
+ * is passed on to `Encoder#stream()`.
  *
  * @param {stream.Readable} stream An Ogg stream encoder that outputs `ogg_packet` Buffer instances.
  * @return {ogg.Encoder} Returns `this` for chaining.
@@ -67,7 +124,7 @@ Encoder.prototype.stream = function(serialno) {
  */
 
 Encoder.prototype.use = function(stream) {
-  stream.pipe(this.stream());
+  stream.pipe(this.stream(undefined, stream.streamOptions));
   return this;
 };
 
@@ -94,14 +151,107 @@ Encoder.prototype._onpage = function(
 
   // got a page!
   var data = page.toBuffer();
+  this._output(stream, data, e_o_s);
+};
+
+/**
+ * Called for each "pages" event, emitted by `EncoderStream#mux()` with the
+ * bytes of all of the pages it produced already in a single Buffer.
+ *
+ * @api private
+ */
+
+Encoder.prototype._onpages = function(
+  stream,
+  data,
+  lengths,
+  granulepos,
+  e_o_s
+) {
+  debug('_onpages(%d pages)', lengths.length);
+
+  if (e_o_s) {
+    // stream is done...
+    delete this.streams[stream.serialno];
+  }
+
+  if (!this._interleaver) return this._output(stream, data, e_o_s);
+
+  // the interleaver orders individual pages
+  var offset = 0;
+  for (var i = 0; i < lengths.length; i++) {
+    var page = data.subarray(offset, offset + lengths[i]);
+    offset += lengths[i];
+    this._interleaver.page(stream, page, e_o_s && i === lengths.length - 1);
+  }
+  this._drain();
+};
+
+/**
+ * Queues the bytes of one or more pages of `stream` for _read(), or hands
+ * them to the interleaver when enabled.
+ *
+ * @api private
+ */
+
+Encoder.prototype._output = function(stream, data, e_o_s) {
+  if (this._interleaver) {
+    this._interleaver.page(stream, data, e_o_s);
+    return this._drain();
+  }
   this._queue.push(data);
   this.emit('_page');
 };
 
+/**
+ * Moves the pages the interleaver has released to the _read() queue.
+ *
+ * @api private
+ */
+
+Encoder.prototype._drain = function() {
+  var n = this._queue.length;
+  this._interleaver.drain(this._queue);
+  if (this._queue.length > n) this.emit('_page');
+};
+
+/**
+ * Copies the bytes of the pages produced so far into `arena`, starting at
+ * `offset`, as far as they fit; whatever doesn't fit is kept for the next
+ * call. Returns the number of bytes copied.
+ *
+ * This is a pull-mode alternative to reading the Encoder as a stream, for
+ * callers that write into a pre-sized output buffer of their own. Pages made
+ * by `EncoderStream#mux()` are copied once, from the Buffer the native call
+ * filled. Pages from `packetin()` followed by `pageout()` or `flush()` have
+ * already been copied out of their `ogg_page` by then, so they are copied
+ * twice. Don't mix it with reading.
+ *
+ * @param {Buffer} arena
+ * @param {Number} offset (optional)
+ * @return {Number} bytes copied
+ * @api public
+ */
+
+Encoder.prototype.readInto = function(arena, offset) {
+  offset = offset || 0;
+  var start = offset;
+  while (this._queue.length && offset < arena.length) {
+    var data = this._queue[0];
+    var n = Math.min(data.length, arena.length - offset);
+    arena.set(n === data.length ? data : data.subarray(0, n), offset);
+    offset += n;
+    if (n === data.length) this._queue.shift();
+    else this._queue[0] = data.subarray(n);
+  }
+  debug('readInto(%d bytes)', offset - start);
+  return offset - start;
+};
+
 /**
  * Readable stream base class `_read()` callback function.
- * Processes the _queue array and attempts to read out any available
- * `ogg_page` instances, converted to raw Buffers.
+ * Processes the _queue array and pushes out every available page Buffer, one
+ * at a time, so that they reach the consumer without another copy.
  *
  * @param {Number} bytes
  * @param {Function} done
@@ -124,17 +274,20 @@ Encoder.prototype._read = function(bytes, done) {
 
   function output() {
     debug('flushing "_queue" (%d entries)', this._queue.length);
-    var buf = Buffer.concat(this._queue);
-    this._queue.splice(0); // empty queue
+    var queue = this._queue.splice(0); // empty queue
 
     // check if there's any more streams being processed
     var n = Object.keys(this.streams).length;
     if (n === 0) {
+      // every stream has ended, so the interleaver has released every page
+      assert(!this._interleaver || !this._interleaver.pending());
       this._needsEnd = true;
     }
 
-    if (this.push) this.push(buf);
-    // emit "end"
-    else done(null, buf); // XXX: compat for old Readable API... remove soon...
+    if (!this.push) {
+      // XXX: compat for old Readable API... remove soon...
+      return done(null, Buffer.concat(queue));
+    }
+    for (var i = 0; i < queue.length; i++) this.push(queue[i]);
   }
 };
@@ -0,0 +1,136 @@
+/**
+ * Module dependencies.
+ */
+
+var debug = require('debug')('ogg:interleaver');
+
+/**
+ * Module exports.
+ */
+
+module.exports = Interleaver;
+
+/**
+ * The `Interleaver` class orders the pages of several logical streams by
+ * presentation time, so that a demuxer reading the muxed bitstream front to
+ * back needs to buffer as little as possible.
+ *
+ * Each stream's time is derived from the granulepos of its pages through the
+ * stream's `granuleTime()` function. A page is released once every other
+ * active stream has a page pending (so nothing earlier can still show up),
+ * once it lags the latest time seen by more than `maxDelay` seconds, or when
+ * some stream has more than `maxPages` pages pending.
+ *
+ * @param {Object} opts `maxDelay` (seconds) and `maxPages`
+ * @api private
+ */
+
+function Interleaver(opts) {
+  if (!(this instanceof Interleaver)) return new Interleaver(opts);
+
+  this.maxDelay = opts && null != opts.maxDelay ? opts.maxDelay : 1;
+  this.maxPages = opts && null != opts.maxPages ? opts.maxPages : 256;
+
+  // per-stream state keyed by serialno
+  this.streams = {};
+
+  // latest presentation time of any page added so far
+  this.latest = -Infinity;
+
+  // arrival counter, breaks ties between pages with equal times
+  this._seq = 0;
+}
+
+/**
+ * Starts tracking `stream`. Until it has ended, pages of other streams are
+ * only released early if they exceed the delay or buffer bounds.
+ *
+ * @param {EncoderStream} stream
+ * @api private
+ */
+
+Interleaver.prototype.add = function (stream) {
+  debug('add(%d)', stream.serialno);
+  this.streams[stream.serialno] = {
+    stream: stream,
+    pages: [],
+    time: 0,
+    ended: false
+  };
+};
+
+/**
+ * Queues a page of `stream`. `page` is a Buffer holding the whole page.
+ *
+ * @param {EncoderStream} stream
+ * @param {Buffer} page
+ * @param {Boolean} e_o_s whether this is the last page of the stream
+ * @api private
+ */
+
+Interleaver.prototype.page = function (stream, page, e_o_s) {
+  var state = this.streams[stream.serialno];
+  if (!state) {
+    this.add(stream);
+    state = this.streams[stream.serialno];
+  }
+
+  // pages on which no packet ends have a granulepos of -1 and belong right
+  // after the previous page of the stream
+  var granulepos = page.readBigInt64LE(6);
+  if (granulepos !== -1n) {
+    state.time = stream.granuleTime(granulepos);
+    if (state.time > this.latest) this.latest = state.time;
+  }
+
+  state.pages.push({ data: page, time: state.time, seq: this._seq++ });
+  if (e_o_s) state.ended = true;
+};
+
+/**
+ * Moves every page that is ready to be written, in presentation order, into
+ * the `out` Array.
+ *
+ * @param {Array} out
+ * @api private
+ */
+
+Interleaver.prototype.drain = function (out) {
+  for (;;) {
+    var next = null;
+    var waiting = false;
+    var full = false;
+    for (var serialno in this.streams) {
+      var state = this.streams[serialno];
+      if (state.pages.length === 0) {
+        if (state.ended) delete this.streams[serialno];
+        else waiting = true;
+        continue;
+      }
+      if (state.pages.length > this.maxPages) full = true;
+      var head = state.pages[0];
+      if (!next || head.time < next.head.time ||
+          (head.time === next.head.time && head.seq < next.head.seq)) {
+        next = { state: state, head: head };
+      }
+    }
+    if (!next) break;
+    if (waiting && !full && next.head.time > this.latest - this.maxDelay) break;
+
+    next.state.pages.shift();
+    out.push(next.head.data);
+  }
+};
+
+/**
+ * Returns whether any pages are still held back.
+ *
+ * @api private
+ */
+
+Interleaver.prototype.pending = function () {
+  for (var serialno in this.streams) {
+    if (this.streams[serialno].pages.length > 0) return true;
+  }
+  return false;
+};
@@ -0,0 +1,34 @@
+/**
+ * Module dependencies.
+ */
+
+var binding = require('./binding');
+
+/**
+ * Module exports.
+ */
+
+module.exports = opusDurations;
+
+/**
+ * Returns the duration of each of the given Opus packets in 48 kHz samples,
+ * as read from their TOC bytes, in an Int32Array. That is exactly how far the
+ * packet advances the granulepos of an Ogg Opus stream, whatever frame sizes
+ * the encoder used. Packets that aren't valid Opus get -1.
+ *
+ * `packets` is a `PacketBatch` (as emitted by the `Decoder` with
+ * `opts.batch`), or an Array of Buffers or `ogg_packet` instances.
+ *
+ * @param {Array|PacketBatch} packets
+ * @return {Int32Array}
+ * @api public
+ */
+
+function opusDurations(packets) {
+  if (Array.isArray(packets)) {
+    packets = packets.map(function (packet) {
+      return packet instanceof binding.ogg_packet ? packet.packet : packet;
+    });
+  }
+  return binding.opus_packet_durations(packets);
+}
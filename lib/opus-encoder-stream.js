@@ -1,12 +1,34 @@
 var util = require('util');
 var Transform = require('stream').Transform;
 var ogg_packet = require('./binding').ogg_packet;
+var opusDurations = require('./opus-durations');
 
 // These are the valid rates for libopus according to
 // https://www.opus-codec.org/docs/opus_api-1.1.2/group__opus__encoder.html#gaa89264fd93c9da70362a0c9b96b9ca88
 var VALID_RATES = [8000, 12000, 16000, 24000, 48000];
 
-var Encoder = function(rate, channels, frameSize) {
+/**
+ * Packs encoded Opus frames into `ogg_packet`s, for piping into an
+ * `EncoderStream` (see `ogg.Encoder#use()`).
+ *
+ * By default every packet is flushed onto a page of its own. Set
+ * `opts.pageDuration` (milliseconds) or `opts.pageBytes` to have libogg fill
+ * pages with several packets instead, which saves a page header per packet.
+ * The headers are always flushed onto pages of their own, as RFC 7845
+ * requires.
+ *
+ * Each packet is normally held back until the next one arrives, so that the
+ * last can be flagged "e_o_s". With `opts.zeroDelay` set, packets are passed
+ * on right away instead, and the end of the stream is marked by the
+ * `EncoderStream` after the fact (see `EncoderStream#eos()`), with an empty
+ * last page if need be.
+ *
+ * Everything read from the stream is an `ogg_packet` instance, except that
+ * with `opts.zeroDelay` the last object is the `{ eos: true }` command
+ * `EncoderStream` takes in place of the "e_o_s" flag. Code reading the
+ * packets directly should treat it as the end of the stream.
+ */
+var Encoder = function(rate, channels, frameSize, opts) {
   Transform.call(this, { readableObjectMode: true });
 
   this.rate = rate || 48000;
@@ -25,6 +47,16 @@ var Encoder = function(rate, channels, frameSize) {
   this.channels = channels || 1;
   this.frameSize = frameSize || this.rate * 0.04;
 
+  // page aggregation, picked up by `ogg.Encoder#use()` for the EncoderStream
+  this.aggregate = Boolean(opts && (opts.pageDuration || opts.pageBytes));
+  this.streamOptions = {
+    granuleRate: 48000,
+    pageBytes: opts && opts.pageBytes,
+    pageDuration: opts && opts.pageDuration ? opts.pageDuration * 48 : null
+  };
+
+  this.zeroDelay = Boolean(opts && opts.zeroDelay);
+
   this.headerWritten = false;
   this.pos = 0;
   this.granulepos = 0;
@@ -110,24 +142,33 @@ Encoder.prototype._pushEncodedBuffer = function(encoded, end) {
     this.push(this.lastPacket);
   }
 
-  // Scale the frame size into 48 kHz bitrate, which is used for the
-  // granule positioning. We'll still update the samplesWritten just to
-  // ensure backwards compatibility.
-  this.granulepos += (this.frameSize / this.rate) * 48000;
-  this.samplesWritten += this.frameSize;
+  // Advance the granule position (always at 48 kHz) by the duration the
+  // packet's TOC byte gives, so that encoders switching frame sizes are
+  // muxed correctly. The configured frame size is only a fallback for
+  // packets that can't be parsed. We'll still update the samplesWritten just
+  // to ensure backwards compatibility.
+  var samples = opusDurations([encoded])[0];
+  if (samples < 0) samples = (this.frameSize / this.rate) * 48000;
+  this.granulepos += samples;
+  this.samplesWritten += (samples * this.rate) / 48000;
 
   var packet = new ogg_packet();
   packet.packet = encoded;
   packet.e_o_s = 0;
   packet.granulepos = this.granulepos;
   packet.packetno = this.pos++;
-  packet.flush = true;
+  if (this.aggregate) packet.pageout = true;
+  else packet.flush = true;
 
-  this.lastPacket = packet;
+  if (this.zeroDelay) this.push(packet);
+  else this.lastPacket = packet;
 };
 
 Encoder.prototype._flush = function(done) {
-  if (this.lastPacket) {
+  if (this.zeroDelay) {
+    // ends the stream after the packets already passed on
+    if (this.headerWritten) this.push({ eos: true });
+  } else if (this.lastPacket) {
     this.lastPacket.e_o_s = 1;
     this.push(this.lastPacket);
   }
@@ -0,0 +1,175 @@
+/**
+ * Module exports.
+ */
+
+module.exports = PacketBatch;
+
+/**
+ * A `PacketBatch` holds any number of packets in struct-of-arrays form: the
+ * payloads are packed into the single `data` ArrayBuffer, and each per-packet
+ * field is a typed array indexed by packet:
+ *
+ *   - `offsets`, `lengths` (Uint32Array): where the payload lives in `data`
+ *   - `b_o_s`, `e_o_s` (Uint8Array): the `ogg_packet` flags
+ *   - `granulepos`, `packetno` (BigInt64Array): full 64-bit values
+ *   - `serialno` (Int32Array): the stream each packet belongs to, or `null`
+ *
+ * The `Decoder` emits these with `opts.batch` set, and `EncoderStream`
+ * accepts them anywhere it accepts an `ogg_packet`.
+ *
+ * @param {Object} fields the typed arrays listed above
+ * @api public
+ */
+
+function PacketBatch(fields) {
+  if (!(this instanceof PacketBatch)) return new PacketBatch(fields);
+  this.data = fields.data;
+  this.serialno = fields.serialno || null;
+  this.offsets = fields.offsets;
+  this.lengths = fields.lengths;
+  this.b_o_s = fields.b_o_s;
+  this.e_o_s = fields.e_o_s;
+  this.granulepos = fields.granulepos;
+  this.packetno = fields.packetno;
+  this._bytes = fields.bytes != null ? fields.bytes : -1;
+}
+
+/**
+ * Number of packets in the batch.
+ *
+ * @api public
+ */
+
+Object.defineProperty(PacketBatch.prototype, 'length', {
+  get: function () {
+    return this.offsets.length;
+  }
+});
+
+/**
+ * Total payload size of the batch in bytes. Only the packets' own payloads
+ * count, as `data` may be shared with the batch this one was selected from.
+ *
+ * @api public
+ */
+
+Object.defineProperty(PacketBatch.prototype, 'bytes', {
+  get: function () {
+    if (this._bytes === -1) {
+      this._bytes = 0;
+      for (var i = 0; i < this.lengths.length; i++) this._bytes += this.lengths[i];
+    }
+    return this._bytes;
+  }
+});
+
+/**
+ * Returns the payload of packet `i` as a Buffer view into `data`.
+ *
+ * @param {Number} i packet index
+ * @return {Buffer}
+ * @api public
+ */
+
+PacketBatch.prototype.packet = function (i) {
+  return Buffer.from(this.data, this.offsets[i], this.lengths[i]);
+};
+
+/**
+ * Returns a batch of only the packets of stream `serialno`. The payloads are
+ * not copied, the new batch shares `data` with this one.
+ *
+ * @param {Number} serialno
+ * @return {PacketBatch}
+ * @api public
+ */
+
+PacketBatch.prototype.select = function (serialno) {
+  var indices = [];
+  for (var i = 0; i < this.length; i++) {
+    if (this.serialno[i] === serialno) indices.push(i);
+  }
+  if (indices.length === this.length) return this;
+
+  function pick(Type, array) {
+    return Type.from(indices, function (i) { return array[i]; });
+  }
+  var lengths = pick(Uint32Array, this.lengths);
+  var bytes = 0;
+  for (i = 0; i < lengths.length; i++) bytes += lengths[i];
+  return new PacketBatch({
+    data: this.data,
+    bytes: bytes,
+    serialno: pick(Int32Array, this.serialno),
+    offsets: pick(Uint32Array, this.offsets),
+    lengths: lengths,
+    b_o_s: pick(Uint8Array, this.b_o_s),
+    e_o_s: pick(Uint8Array, this.e_o_s),
+    granulepos: pick(BigInt64Array, this.granulepos),
+    packetno: pick(BigInt64Array, this.packetno)
+  });
+};
+
+/**
+ * Returns the distinct serialnos of the batch, in order of first appearance.
+ *
+ * @return {Array}
+ * @api public
+ */
+
+PacketBatch.prototype.streams = function () {
+  var seen = [];
+  for (var i = 0; i < this.length; i++) {
+    if (seen.indexOf(this.serialno[i]) === -1) seen.push(this.serialno[i]);
+  }
+  return seen;
+};
+
+/**
+ * Packs an Array of `ogg_packet` instances (or plain objects with the same
+ * `packet`, `b_o_s`, `e_o_s`, `granulepos` and `packetno` properties) into a
+ * new batch, copying their payloads once.
+ *
+ * @param {Array} packets
+ * @return {PacketBatch}
+ * @api public
+ */
+
+PacketBatch.from = function (packets) {
+  var n = packets.length;
+  var offsets = new Uint32Array(n);
+  var lengths = new Uint32Array(n);
+  var total = 0;
+  var i;
+  for (i = 0; i < n; i++) {
+    offsets[i] = total;
+    lengths[i] = packets[i].packet.length;
+    total += lengths[i];
+  }
+
+  var data = new ArrayBuffer(total);
+  var bytes = new Uint8Array(data);
+  var b_o_s = new Uint8Array(n);
+  var e_o_s = new Uint8Array(n);
+  var granulepos = new BigInt64Array(n);
+  var packetno = new BigInt64Array(n);
+  for (i = 0; i < n; i++) {
+    var p = packets[i];
+    bytes.set(p.packet, offsets[i]);
+    b_o_s[i] = p.b_o_s ? 1 : 0;
+    e_o_s[i] = p.e_o_s ? 1 : 0;
+    granulepos[i] = BigInt(p.granulepos || 0);
+    packetno[i] = BigInt(p.packetno || 0);
+  }
+
+  return new PacketBatch({
+    data: data,
+    bytes: total,
+    offsets: offsets,
+    lengths: lengths,
+    b_o_s: b_o_s,
+    e_o_s: e_o_s,
+    granulepos: granulepos,
+    packetno: packetno
+  });
+};
@@ -0,0 +1,75 @@
+/**
+ * Module dependencies.
+ */
+
+var binding = require('./binding');
+
+/**
+ * Module exports.
+ */
+
+module.exports = scanPages;
+
+/**
+ * Locates and validates the Ogg pages in `buffer`, starting at byte `offset`,
+ * without copying it into an `ogg_sync_state` first. The result describes
+ * each complete page found with parallel typed arrays:
+ *
+ *   - `offsets`, `lengths` (Uint32Array): where the page lives in `buffer`
+ *   - `serialno` (Int32Array), `granulepos` (BigInt64Array)
+ *   - `flags` (Uint8Array): the header type byte (1 continued, 2 bos, 4 eos)
+ *   - `crc` (Uint8Array): 1 when the checksum verifies, 0 when it doesn't
+ *
+ * plus `next`, the offset of a page that runs past the end of `buffer` (or
+ * `buffer.length`), to resume from once more data follows it. As `offsets`
+ * are 32-bit, `buffer` must be smaller than 4 GiB or a RangeError is thrown;
+ * scan larger inputs in pieces.
+ *
+ * Without a callback the scan runs synchronously and the result is returned.
+ * With one, buffers of `binding.asyncThreshold` bytes and more are scanned on
+ * the thread pool and `fn(err, result)` is called when done; invalid
+ * arguments are reported to `fn` too, rather than thrown.
+ *
+ * @param {Buffer} buffer
+ * @param {Number} offset defaults to 0
+ * @param {Function} fn optional callback
+ * @return {Object}
+ * @api public
+ */
+
+function scanPages(buffer, offset, fn) {
+  if ('function' == typeof offset) {
+    fn = offset;
+    offset = 0;
+  }
+  offset = offset || 0;
+
+  if (!fn) return binding.ogg_scan_pagesSync(buffer, offset)[1];
+  var err = checkArgs(buffer, offset);
+  if (err) return fn(err);
+  binding.dispatch('ogg_scan_pages', buffer.length - offset, null,
+    [ buffer, offset ], fn);
+}
+
+/**
+ * Returns the error `ogg_scan_pages` would throw for `buffer` and `offset`,
+ * or null when they are fine.
+ *
+ * @param {Buffer} buffer
+ * @param {Number} offset
+ * @return {Error}
+ * @api private
+ */
+
+function checkArgs(buffer, offset) {
+  if (!(buffer instanceof Uint8Array)) {
+    return new TypeError('buffer must be a Buffer or Uint8Array');
+  }
+  if (buffer.length > 0xffffffff) {
+    return new RangeError('buffer must be smaller than 4 GiB');
+  }
+  if ('number' == typeof offset && !(offset >= 0 && offset <= buffer.length)) {
+    return new RangeError('offset is outside of the buffer');
+  }
+  return null;
+}
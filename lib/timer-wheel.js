@@ -0,0 +1,157 @@
+/**
+ * Module dependencies.
+ */
+
+var debug = require('debug')('ogg:timer-wheel');
+
+/**
+ * Module exports.
+ */
+
+module.exports = TimerWheel;
+
+/**
+ * The `TimerWheel` class runs any number of timeouts off a single interval
+ * timer. Timeouts are hashed into `opts.size` slots (defaults to 512) of
+ * `opts.tick` milliseconds each (defaults to 10), so adding and removing one
+ * is O(1) however many are pending, and they fire up to a tick late. Those
+ * further out than one turn of the wheel wait in their slot for as many
+ * turns as needed.
+ *
+ * The interval only runs while timeouts are pending, and doesn't keep the
+ * process alive on its own.
+ *
+ * @param {Object} opts `tick` (milliseconds) and `size`
+ * @api private
+ */
+
+function TimerWheel(opts) {
+  if (!(this instanceof TimerWheel)) return new TimerWheel(opts);
+
+  this.tick = opts && opts.tick || 10;
+  this.size = opts && opts.size || 512;
+
+  this.slots = [];
+  for (var i = 0; i < this.size; i++) this.slots.push(new Set());
+
+  // slot the wheel is at, and when it got there
+  this.cursor = 0;
+  this.time = 0;
+
+  this.count = 0;
+  this._interval = null;
+  this._advance = this._advance.bind(this);
+}
+
+/**
+ * Wheel shared by every `Encoder`, created on first use.
+ *
+ * @api private
+ */
+
+var shared = null;
+
+TimerWheel.shared = function () {
+  if (!shared) shared = new TimerWheel();
+  return shared;
+};
+
+/**
+ * Calls `timer.fn()` in `delay` milliseconds, unless `timer` is removed
+ * first. `timer` is any object with a `fn` function; re-adding a pending
+ * timer moves it.
+ *
+ * @param {Object} timer
+ * @param {Number} delay milliseconds
+ * @api private
+ */
+
+TimerWheel.prototype.add = function (timer, delay) {
+  if (timer.wheelSlot != null) this.remove(timer);
+  if (this.count === 0) this._start();
+
+  // counted from the time of the current slot, which may be up to a tick ago
+  var elapsed = Date.now() - this.time;
+  var ticks = Math.max(1, Math.ceil((elapsed + delay) / this.tick));
+  timer.wheelSlot = (this.cursor + ticks) % this.size;
+  timer.wheelTurns = Math.floor((ticks - 1) / this.size);
+  this.slots[timer.wheelSlot].add(timer);
+  this.count++;
+};
+
+/**
+ * Returns whether `timer` is pending.
+ *
+ * @param {Object} timer
+ * @api private
+ */
+
+TimerWheel.prototype.has = function (timer) {
+  return timer.wheelSlot != null;
+};
+
+/**
+ * Cancels `timer` if it is pending.
+ *
+ * @param {Object} timer
+ * @api private
+ */
+
+TimerWheel.prototype.remove = function (timer) {
+  if (timer.wheelSlot == null) return;
+  this.slots[timer.wheelSlot].delete(timer);
+  timer.wheelSlot = null;
+  if (--this.count === 0) this._stop();
+};
+
+/**
+ * Starts the interval, with the wheel at the current time.
+ *
+ * @api private
+ */
+
+TimerWheel.prototype._start = function () {
+  debug('_start()');
+  this.time = Date.now();
+  this._interval = setInterval(this._advance, this.tick);
+  if (this._interval.unref) this._interval.unref();
+};
+
+/**
+ * Stops the interval once no timeouts are left.
+ *
+ * @api private
+ */
+
+TimerWheel.prototype._stop = function () {
+  debug('_stop()');
+  clearInterval(this._interval);
+  this._interval = null;
+};
+
+/**
+ * Interval callback. Moves the wheel on by however many ticks have passed,
+ * which may be more than one when the event loop was busy, firing the
+ * timeouts due in each slot passed.
+ *
+ * @api private
+ */
+
+TimerWheel.prototype._advance = function () {
+  var now = Date.now();
+  while (this._interval && now - this.time >= this.tick) {
+    this.time += this.tick;
+    this.cursor = (this.cursor + 1) % this.size;
+    var due = [];
+    this.slots[this.cursor].forEach(function (timer) {
+      if (timer.wheelTurns > 0) timer.wheelTurns--;
+      else due.push(timer);
+    });
+    for (var i = 0; i < due.length; i++) {
+      // a timeout fired earlier may have removed or moved this one
+      if (due[i].wheelSlot !== this.cursor || due[i].wheelTurns > 0) continue;
+      this.remove(due[i]);
+      due[i].fn();
+    }
+  }
+};
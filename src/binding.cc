@@ -22,13 +22,50 @@
 
 #include <napi.h>
 
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "demux.hxx"
 #include "ogg/ogg.h"
 #include "ogg_struct_wrappers.hxx"
+#include "opus_toc.hxx"
+#include "packet_batch.hxx"
+#include "page_scan.hxx"
+#include "slab.hxx"
 
 namespace nodeogg {
 
 napi_property_attributes property_writable_enumerable =
     static_cast<napi_property_attributes>(napi_enumerable | napi_writable);
+
+// `Buffer.from(arrayBuffer, byteOffset, length)`, for Buffer views onto
+// natively allocated memory
+static Napi::FunctionReference bufferFrom;
+
+static Napi::TypedArrayOf<uint8_t> buffer_view(Napi::ArrayBuffer arrayBuffer,
+                                               size_t offset, size_t length) {
+  Napi::Env env = arrayBuffer.Env();
+  return bufferFrom
+      .Call({arrayBuffer, Napi::Number::New(env, static_cast<double>(offset)),
+             Napi::Number::New(env, static_cast<double>(length))})
+      .As<Napi::TypedArrayOf<uint8_t>>();
+}
+
+// Returns the Buffer held by `ref` if it still describes `data`, so that the
+// getters hand out the object that keeps the memory alive rather than an
+// unowned Buffer pointing into it. Returns an empty value otherwise.
+static Napi::Value referenced_buffer(
+    Napi::Reference<Napi::TypedArrayOf<uint8_t>> &ref, const uint8_t *data,
+    size_t length) {
+  if (ref.IsEmpty()) return Napi::Value();
+  Napi::TypedArrayOf<uint8_t> value = ref.Value();
+  if (!value.IsBuffer() || value.Data() != data ||
+      value.ByteLength() != length)
+    return Napi::Value();
+  return value;
+}
 OggPage::OggPage(const Napi::CallbackInfo &info)
     : Napi::ObjectWrap<OggPage>(info) {
   memset(&op, 0, sizeof(op));
@@ -66,7 +103,8 @@ void OggPage::setHeader(const Napi::CallbackInfo &info,
   }
 
   Napi::TypedArrayOf<uint8_t> header = value.As<Napi::TypedArrayOf<uint8_t>>();
-  jsBufferHeaderRef = Napi::Reference<Napi::TypedArrayOf<uint8_t>>::New(header);
+  jsBufferHeaderRef =
+      Napi::Reference<Napi::TypedArrayOf<uint8_t>>::New(header, 1);
 
   op.header = header.Data();
   op.header_len = header.ByteLength();
@@ -74,6 +112,8 @@ void OggPage::setHeader(const Napi::CallbackInfo &info,
 
 Napi::Value OggPage::getHeader(const Napi::CallbackInfo &info) {
   Napi::Env env = info.Env();
+  Napi::Value buffer = referenced_buffer(jsBufferHeaderRef, op.header, op.header_len);
+  if (!buffer.IsEmpty()) return buffer;
   return Napi::Buffer<uint8_t>::New(env, op.header, op.header_len);
 }
 
@@ -87,13 +127,15 @@ void OggPage::setBody(const Napi::CallbackInfo &info,
   }
 
   Napi::TypedArrayOf<uint8_t> body = value.As<Napi::TypedArrayOf<uint8_t>>();
-  jsBufferBodyRef = Napi::Reference<Napi::TypedArrayOf<uint8_t>>::New(body);
+  jsBufferBodyRef = Napi::Reference<Napi::TypedArrayOf<uint8_t>>::New(body, 1);
   op.body = body.Data();
   op.body_len = body.ByteLength();
 }
 
 Napi::Value OggPage::getBody(const Napi::CallbackInfo &info) {
   Napi::Env env = info.Env();
+  Napi::Value buffer = referenced_buffer(jsBufferBodyRef, op.body, op.body_len);
+  if (!buffer.IsEmpty()) return buffer;
   return Napi::Buffer<uint8_t>::New(env, op.body, op.body_len);
 }
 
@@ -112,6 +154,31 @@ Napi::Object OggPage::NewInstance(Napi::Value arg) {
   return obj;
 }
 
+Napi::Object OggPage::NewCopy(Napi::Env env, const ogg_page *og) {
+  return NewFromBuffers(
+      env, Napi::Buffer<uint8_t>::Copy(env, og->header, og->header_len),
+      Napi::Buffer<uint8_t>::Copy(env, og->body, og->body_len));
+}
+
+Napi::Object OggPage::NewFromBuffers(Napi::Env env,
+                                     Napi::TypedArrayOf<uint8_t> header,
+                                     Napi::TypedArrayOf<uint8_t> body) {
+  Napi::Object obj = NewInstance(env.Undefined());
+  OggPage *page = Napi::ObjectWrap<OggPage>::Unwrap(obj);
+
+  page->jsBufferHeaderRef =
+      Napi::Reference<Napi::TypedArrayOf<uint8_t>>::New(header, 1);
+  page->op.header = header.Data();
+  page->op.header_len = header.ByteLength();
+
+  page->jsBufferBodyRef =
+      Napi::Reference<Napi::TypedArrayOf<uint8_t>>::New(body, 1);
+  page->op.body = body.Data();
+  page->op.body_len = body.ByteLength();
+
+  return obj;
+}
+
 //
 // --------------
 //
@@ -150,6 +217,8 @@ void OggPacket::Init(Napi::Env env, Napi::Object exports) {
 
 Napi::Value OggPacket::packet(const Napi::CallbackInfo &info) {
   Napi::Env env = info.Env();
+  Napi::Value buffer = referenced_buffer(jsBufferRef, op.packet, op.bytes);
+  if (!buffer.IsEmpty()) return buffer;
   return Napi::Buffer<uint8_t>::New(env, op.packet, op.bytes);
 }
 
@@ -163,7 +232,7 @@ void OggPacket::setPacket(const Napi::CallbackInfo &info,
   }
   Napi::TypedArrayOf<uint8_t> packet =
       info[0].As<Napi::TypedArrayOf<uint8_t>>();
-  jsBufferRef = Napi::Reference<Napi::TypedArrayOf<uint8_t>>::New(packet);
+  jsBufferRef = Napi::Reference<Napi::TypedArrayOf<uint8_t>>::New(packet, 1);
   op.packet = packet.Data();
   op.bytes = packet.ByteLength();
 }
@@ -238,13 +307,48 @@ Napi::Object OggPacket::NewInstance(Napi::Value arg) {
   return obj;
 }
 
+bool OggPacket::IsInstance(Napi::Value value) {
+  return value.IsObject() &&
+         value.As<Napi::Object>().InstanceOf(constructor.Value());
+}
+
+Napi::Object OggPacket::NewCopy(Napi::Env env, const ogg_packet *op) {
+  return NewFromBuffer(env, op,
+                       Napi::Buffer<uint8_t>::Copy(env, op->packet, op->bytes));
+}
+
+Napi::Object OggPacket::NewFromBuffer(Napi::Env env, const ogg_packet *op,
+                                      Napi::TypedArrayOf<uint8_t> data) {
+  Napi::Object obj = NewInstance(env.Undefined());
+  OggPacket *packet = Napi::ObjectWrap<OggPacket>::Unwrap(obj);
+
+  packet->jsBufferRef = Napi::Reference<Napi::TypedArrayOf<uint8_t>>::New(data, 1);
+  packet->op = *op;
+  packet->op.packet = data.Data();
+  packet->op.bytes = data.ByteLength();
+
+  return obj;
+}
+
 //
 // -----------
 //
 
+// Applies the `ring` option of `ogg_sync_state` and `ogg_decoder`: `true`, or
+// a size in bytes, switches `oy` to a ring buffer (see `ogg_sync_ring()`).
+// Where the platform has no rings `oy` quietly keeps its plain buffer.
+static void sync_ring_option(ogg_sync_state *oy, Napi::Value ring) {
+  if (ring.IsNumber())
+    ogg_sync_ring(oy, static_cast<long>(ring.As<Napi::Number>().Int64Value()));
+  else if (ring.ToBoolean())
+    ogg_sync_ring(oy, 128 * 1024);
+}
+
 OggSyncState::OggSyncState(const Napi::CallbackInfo &info)
     : Napi::ObjectWrap<OggSyncState>(info) {
   ogg_sync_init(&oy);
+  if (info[0].IsObject())
+    sync_ring_option(&oy, info[0].As<Napi::Object>().Get("ring"));
 };
 
 Napi::FunctionReference OggSyncState::constructor;
@@ -254,7 +358,12 @@ OggSyncState::~OggSyncState() { ogg_sync_clear(&oy); }
 void OggSyncState::Init(Napi::Env env, Napi::Object exports) {
   Napi::HandleScope scope(env);
 
-  Napi::Function func = DefineClass(env, "ogg_sync_state", {});
+  Napi::Function func = DefineClass(
+      env, "ogg_sync_state",
+      {InstanceAccessor("reallocs", &OggSyncState::reallocs, nullptr,
+                        napi_enumerable),
+       InstanceAccessor("ring", &OggSyncState::ring, nullptr,
+                        napi_enumerable)});
 
   constructor = Napi::Persistent(func);
   constructor.SuppressDestruct();
@@ -262,6 +371,14 @@ void OggSyncState::Init(Napi::Env env, Napi::Object exports) {
   exports.Set("ogg_sync_state", func);
 }
 
+Napi::Value OggSyncState::reallocs(const Napi::CallbackInfo &info) {
+  return Napi::Number::New(info.Env(), oy.reallocs);
+}
+
+Napi::Value OggSyncState::ring(const Napi::CallbackInfo &info) {
+  return Napi::Boolean::New(info.Env(), oy.ring != NULL);
+}
+
 Napi::Object OggSyncState::NewInstance(Napi::Value arg) {
   Napi::Object obj = constructor.New({arg});
   return obj;
@@ -273,12 +390,7 @@ class OggSyncWriteWorker : public Napi::AsyncWorker {
                      Napi::Function &callback)
       : Napi::AsyncWorker(callback), oy(oy), buffer(buffer), rtn(0) {}
   ~OggSyncWriteWorker() {}
-  void Execute() {
-    size_t byteLength = buffer.ByteLength();
-    char *localBuffer = ogg_sync_buffer(oy, byteLength);
-    memcpy(localBuffer, buffer.Data(), byteLength);
-    rtn = ogg_sync_wrote(oy, byteLength);
-  }
+  void Execute() { rtn = sync_write(oy, buffer.Data(), buffer.ByteLength()); }
 
   void OnOK() {
     Napi::Env env = Env();
@@ -301,9 +413,18 @@ void node_ogg_sync_write(const Napi::CallbackInfo &info) {
   (new OggSyncWriteWorker(&syncState->oy, data, cb))->Queue();
 }
 
-/* combination of "ogg_sync_buffer", "memcpy", and "ogg_sync_wrote" on the
- * thread pool.
+/* Same as `ogg_sync_write`, but runs on the calling thread and returns the
+ * result instead of invoking a callback.
  */
+Napi::Value node_ogg_sync_write_sync(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  OggSyncState *syncState =
+      Napi::ObjectWrap<OggSyncState>::Unwrap(info[0].As<Napi::Object>());
+  Napi::TypedArrayOf<uint8_t> data = info[1].As<Napi::TypedArrayOf<uint8_t>>();
+
+  return Napi::Number::New(
+      env, sync_write(&syncState->oy, data.Data(), data.ByteLength()));
+}
 
 /* Reads out an `ogg_page` struct. */
 class OggSyncPageoutWorker : public Napi::AsyncWorker {
@@ -348,6 +469,27 @@ void node_ogg_sync_pageout(const Napi::CallbackInfo &info) {
   (new OggSyncPageoutWorker(&syncState->oy, &page->op, cb))->Queue();
 }
 
+Napi::Value node_ogg_sync_pageout_sync(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  OggSyncState *syncState =
+      Napi::ObjectWrap<OggSyncState>::Unwrap(info[0].As<Napi::Object>());
+  OggPage *page = Napi::ObjectWrap<OggPage>::Unwrap(info[1].As<Napi::Object>());
+
+  int serialno = -1;
+  int packets = -1;
+  int rtn = ogg_sync_pageout(&syncState->oy, &page->op);
+  if (rtn == 1) {
+    serialno = ogg_page_serialno(&page->op);
+    packets = ogg_page_packets(&page->op);
+  }
+
+  Napi::Array result = Napi::Array::New(env, 3);
+  result.Set(0u, Napi::Number::New(env, rtn));
+  result.Set(1u, Napi::Number::New(env, serialno));
+  result.Set(2u, Napi::Number::New(env, packets));
+  return result;
+}
+
 static int serial = 1;
 OggStreamState::OggStreamState(const Napi::CallbackInfo &info)
     : Napi::ObjectWrap<OggStreamState>(info) {
@@ -366,7 +508,10 @@ OggStreamState::~OggStreamState() { ogg_stream_clear(&os); }
 void OggStreamState::Init(Napi::Env env, Napi::Object exports) {
   Napi::HandleScope scope(env);
 
-  Napi::Function func = DefineClass(env, "ogg_stream_state", {});
+  Napi::Function func = DefineClass(
+      env, "ogg_stream_state",
+      {InstanceAccessor("reallocs", &OggStreamState::reallocs, nullptr,
+                        napi_enumerable)});
 
   constructor = Napi::Persistent(func);
   constructor.SuppressDestruct();
@@ -374,6 +519,19 @@ void OggStreamState::Init(Napi::Env env, Napi::Object exports) {
   exports.Set("ogg_stream_state", func);
 }
 
+Napi::Value OggStreamState::reallocs(const Napi::CallbackInfo &info) {
+  return Napi::Number::New(info.Env(), os.reallocs);
+}
+
+void OggStreamState::Hold(int64_t end, Napi::ObjectReference &ref) {
+  if (end > os.refs.released) held.push_back(std::make_pair(end, std::move(ref)));
+}
+
+void OggStreamState::Release() {
+  while (!held.empty() && held.front().first <= os.refs.released)
+    held.pop_front();
+}
+
 Napi::Object OggStreamState::NewInstance(Napi::Value arg) {
   Napi::Object obj = constructor.New({arg});
   return obj;
@@ -408,6 +566,16 @@ void node_ogg_stream_pagein(const Napi::CallbackInfo &info) {
   (new OggStreamPageinWorker(&streamState->os, &page->op, cb))->Queue();
 }
 
+Napi::Value node_ogg_stream_pagein_sync(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  OggStreamState *streamState =
+      Napi::ObjectWrap<OggStreamState>::Unwrap(info[0].As<Napi::Object>());
+  OggPage *page = Napi::ObjectWrap<OggPage>::Unwrap(info[1].As<Napi::Object>());
+
+  return Napi::Number::New(env,
+                           ogg_stream_pagein(&streamState->os, &page->op));
+}
+
 /* Reads a `ogg_packet` struct from a `ogg_stream_state`. */
 class OggStreamPacketoutWorker : public Napi::AsyncWorker {
  public:
@@ -446,6 +614,32 @@ void node_ogg_stream_packetout(const Napi::CallbackInfo &info) {
   (new OggStreamPacketoutWorker(&streamState->os, &oggPacket->op, cb))->Queue();
 }
 
+Napi::Value node_ogg_stream_packetout_sync(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  OggStreamState *streamState =
+      Napi::ObjectWrap<OggStreamState>::Unwrap(info[0].As<Napi::Object>());
+  OggPacket *oggPacket =
+      Napi::ObjectWrap<OggPacket>::Unwrap(info[1].As<Napi::Object>());
+  ogg_packet *packet = &oggPacket->op;
+
+  int rtn = ogg_stream_packetout(&streamState->os, packet);
+
+  Napi::Array result = Napi::Array::New(env, 6);
+  result.Set(0u, Napi::Number::New(env, rtn));
+  if (rtn == 1) {
+    result.Set(1u, Napi::Number::New(env, packet->bytes));
+    result.Set(2u, Napi::Number::New(env, packet->b_o_s));
+    result.Set(3u, Napi::Number::New(env, packet->e_o_s));
+    result.Set(4u,
+               Napi::Number::New(env, static_cast<double>(packet->granulepos)));
+    result.Set(5u,
+               Napi::Number::New(env, static_cast<double>(packet->packetno)));
+  } else {
+    for (uint32_t i = 1; i < 6; i++) result.Set(i, env.Null());
+  }
+  return result;
+}
+
 /* Writes a `ogg_packet` struct to a `ogg_stream_state`. */
 class OggStreamPacketinWorker : public Napi::AsyncWorker {
  public:
@@ -477,6 +671,32 @@ void node_ogg_stream_packetin(const Napi::CallbackInfo &info) {
   (new OggStreamPacketinWorker(&streamState->os, &oggPacket->op, cb))->Queue();
 }
 
+Napi::Value node_ogg_stream_packetin_sync(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  OggStreamState *streamState =
+      Napi::ObjectWrap<OggStreamState>::Unwrap(info[0].As<Napi::Object>());
+  OggPacket *oggPacket =
+      Napi::ObjectWrap<OggPacket>::Unwrap(info[1].As<Napi::Object>());
+
+  return Napi::Number::New(
+      env, ogg_stream_packetin(&streamState->os, &oggPacket->op));
+}
+
+// The `[rtn, header_len, body_len, e_o_s]` tuple shared by the synchronous
+// pageout and flush variants.
+static Napi::Value stream_page_result(Napi::Env env, int rtn, ogg_page *page) {
+  Napi::Array result = Napi::Array::New(env, 4);
+  result.Set(0u, Napi::Number::New(env, rtn));
+  if (rtn == 1) {
+    result.Set(1u, Napi::Number::New(env, page->header_len));
+    result.Set(2u, Napi::Number::New(env, page->body_len));
+    result.Set(3u, Napi::Number::New(env, ogg_page_eos(page)));
+  } else {
+    for (uint32_t i = 1; i < 4; i++) result.Set(i, env.Null());
+  }
+  return result;
+}
+
 // Since both StreamPageout and StreamFlush have the same HandleOKCallback,
 // this base class deals with both.
 class StreamWorker : public Napi::AsyncWorker {
@@ -502,13 +722,31 @@ class StreamWorker : public Napi::AsyncWorker {
   int rtn;
 };
 
+// The nominal page size used by `ogg_stream_pageout()` and
+// `ogg_stream_flush()`.
+static const int default_page_fill = 4096;
+
+// Reads the `nfill` argument of the `*_fill` variants.
+static bool page_fill_arg(Napi::Value value, int *nfill) {
+  if (!value.IsNumber()) {
+    Napi::TypeError::New(value.Env(), "nfill must be a Number")
+        .ThrowAsJavaScriptException();
+    return false;
+  }
+  *nfill = value.As<Napi::Number>().Int32Value();
+  return true;
+}
+
 class StreamPageoutWorker : public StreamWorker {
  public:
-  StreamPageoutWorker(ogg_stream_state *os, ogg_page *page,
+  StreamPageoutWorker(ogg_stream_state *os, ogg_page *page, int nfill,
                       Napi::Function &callback)
-      : StreamWorker(os, page, callback) {}
+      : StreamWorker(os, page, callback), nfill(nfill) {}
   ~StreamPageoutWorker() {}
-  void Execute() { rtn = ogg_stream_pageout(os, page); }
+  void Execute() { rtn = ogg_stream_pageout_fill(os, page, nfill); }
+
+ private:
+  int nfill;
 };
 
 void node_ogg_stream_pageout(const Napi::CallbackInfo &info) {
@@ -517,17 +755,53 @@ void node_ogg_stream_pageout(const Napi::CallbackInfo &info) {
   OggPage *page = Napi::ObjectWrap<OggPage>::Unwrap(info[1].As<Napi::Object>());
   Napi::Function cb = info[2].As<Napi::Function>();
 
-  (new StreamPageoutWorker(&streamState->os, &page->op, cb))->Queue();
+  (new StreamPageoutWorker(&streamState->os, &page->op, default_page_fill, cb))
+      ->Queue();
+}
+
+Napi::Value node_ogg_stream_pageout_sync(const Napi::CallbackInfo &info) {
+  OggStreamState *streamState =
+      Napi::ObjectWrap<OggStreamState>::Unwrap(info[0].As<Napi::Object>());
+  OggPage *page = Napi::ObjectWrap<OggPage>::Unwrap(info[1].As<Napi::Object>());
+
+  int rtn = ogg_stream_pageout(&streamState->os, &page->op);
+  return stream_page_result(info.Env(), rtn, &page->op);
+}
+
+/* `ogg_stream_pageout()` with a nominal page size of `nfill` bytes. */
+void node_ogg_stream_pageout_fill(const Napi::CallbackInfo &info) {
+  OggStreamState *streamState =
+      Napi::ObjectWrap<OggStreamState>::Unwrap(info[0].As<Napi::Object>());
+  OggPage *page = Napi::ObjectWrap<OggPage>::Unwrap(info[1].As<Napi::Object>());
+  int nfill;
+  if (!page_fill_arg(info[2], &nfill)) return;
+  Napi::Function cb = info[3].As<Napi::Function>();
+
+  (new StreamPageoutWorker(&streamState->os, &page->op, nfill, cb))->Queue();
+}
+
+Napi::Value node_ogg_stream_pageout_fill_sync(const Napi::CallbackInfo &info) {
+  OggStreamState *streamState =
+      Napi::ObjectWrap<OggStreamState>::Unwrap(info[0].As<Napi::Object>());
+  OggPage *page = Napi::ObjectWrap<OggPage>::Unwrap(info[1].As<Napi::Object>());
+  int nfill;
+  if (!page_fill_arg(info[2], &nfill)) return info.Env().Undefined();
+
+  int rtn = ogg_stream_pageout_fill(&streamState->os, &page->op, nfill);
+  return stream_page_result(info.Env(), rtn, &page->op);
 }
 
 /* Reads out a `ogg_page` struct from an `ogg_stream_state`. */
 class StreamFlushWorker : public StreamWorker {
  public:
-  StreamFlushWorker(ogg_stream_state *os, ogg_page *page,
+  StreamFlushWorker(ogg_stream_state *os, ogg_page *page, int nfill,
                     Napi::Function &callback)
-      : StreamWorker(os, page, callback) {}
+      : StreamWorker(os, page, callback), nfill(nfill) {}
   ~StreamFlushWorker() {}
-  void Execute() { rtn = ogg_stream_flush(os, page); }
+  void Execute() { rtn = ogg_stream_flush_fill(os, page, nfill); }
+
+ private:
+  int nfill;
 };
 
 /* Forces an `ogg_page` struct to be flushed from an `ogg_stream_state`. */
@@ -537,17 +811,1228 @@ void node_ogg_stream_flush(const Napi::CallbackInfo &info) {
   OggPage *page = Napi::ObjectWrap<OggPage>::Unwrap(info[1].As<Napi::Object>());
   Napi::Function cb = info[2].As<Napi::Function>();
 
-  (new StreamFlushWorker(&streamState->os, &page->op, cb))->Queue();
+  (new StreamFlushWorker(&streamState->os, &page->op, default_page_fill, cb))
+      ->Queue();
+}
+
+Napi::Value node_ogg_stream_flush_sync(const Napi::CallbackInfo &info) {
+  OggStreamState *streamState =
+      Napi::ObjectWrap<OggStreamState>::Unwrap(info[0].As<Napi::Object>());
+  OggPage *page = Napi::ObjectWrap<OggPage>::Unwrap(info[1].As<Napi::Object>());
+
+  int rtn = ogg_stream_flush(&streamState->os, &page->op);
+  return stream_page_result(info.Env(), rtn, &page->op);
+}
+
+/* `ogg_stream_flush()` with a nominal page size of `nfill` bytes. */
+void node_ogg_stream_flush_fill(const Napi::CallbackInfo &info) {
+  OggStreamState *streamState =
+      Napi::ObjectWrap<OggStreamState>::Unwrap(info[0].As<Napi::Object>());
+  OggPage *page = Napi::ObjectWrap<OggPage>::Unwrap(info[1].As<Napi::Object>());
+  int nfill;
+  if (!page_fill_arg(info[2], &nfill)) return;
+  Napi::Function cb = info[3].As<Napi::Function>();
+
+  (new StreamFlushWorker(&streamState->os, &page->op, nfill, cb))->Queue();
+}
+
+Napi::Value node_ogg_stream_flush_fill_sync(const Napi::CallbackInfo &info) {
+  OggStreamState *streamState =
+      Napi::ObjectWrap<OggStreamState>::Unwrap(info[0].As<Napi::Object>());
+  OggPage *page = Napi::ObjectWrap<OggPage>::Unwrap(info[1].As<Napi::Object>());
+  int nfill;
+  if (!page_fill_arg(info[2], &nfill)) return info.Env().Undefined();
+
+  int rtn = ogg_stream_flush_fill(&streamState->os, &page->op, nfill);
+  return stream_page_result(info.Env(), rtn, &page->op);
+}
+
+/* Ends the logical stream after its last packet went in without "e_o_s"; the
+ * next flush writes the "eos" page, empty if no packets are left. Nothing to
+ * offload to the thread pool.
+ */
+Napi::Value node_ogg_stream_end(const Napi::CallbackInfo &info) {
+  OggStreamState *streamState =
+      Napi::ObjectWrap<OggStreamState>::Unwrap(info[0].As<Napi::Object>());
+  return Napi::Number::New(info.Env(), ogg_stream_end(&streamState->os));
+}
+
+//
+// -----------
+//
+
+// New `ogg_packet` instance for `op` whose payload has already been copied
+// into `slab`, or an owned copy when it didn't fit in one.
+static Napi::Object slab_packet(Napi::Env env, ogg_packet *op, Slab *slab,
+                                size_t offset) {
+  if (slab == NULL) return OggPacket::NewCopy(env, op);
+  return OggPacket::NewFromBuffer(env, op,
+                                  buffer_view(slab->Value(env), offset,
+                                              static_cast<size_t>(op->bytes)));
+}
+
+/* The `ogg_stream_state` of each serialno met while demuxing, created on
+ * first use. Touches no JS, so it can be used off the main thread.
+ */
+class NativeStreams {
+ public:
+  ~NativeStreams() {
+    std::map<int, ogg_stream_state *>::iterator it;
+    for (it = known.begin(); it != known.end(); ++it) {
+      ogg_stream_clear(it->second);
+      delete it->second;
+    }
+  }
+
+  ogg_stream_state *Get(int serialno) {
+    std::map<int, ogg_stream_state *>::iterator it = known.find(serialno);
+    if (it != known.end()) return it->second;
+
+    ogg_stream_state *os = new ogg_stream_state;
+    if (ogg_stream_init(os, serialno) != 0) {
+      delete os;
+      return NULL;
+    }
+    known[serialno] = os;
+    return os;
+  }
+
+ private:
+  std::map<int, ogg_stream_state *> known;
+};
+
+/* Demux sink used on the thread pool: packet payloads are copied into
+ * `slabs` (oversized packets into a native buffer of their own) and every
+ * page into `pageData`, and all are turned into JS objects by `ToJS()` once
+ * back on the main thread. Pages are always kept, as whether anything
+ * listens for them is only known once JS has seen the "stream" events.
+ */
+class NativeDemuxSink {
+ public:
+  struct Entry {
+    bool page;
+    int serialno;
+    Slab *slab;  // NULL when the payload lives in `data`
+    size_t offset;
+    ogg_page og;
+    ogg_packet op;
+  };
+
+  NativeDemuxSink(NativeStreams *streams, SlabAllocator *slabs)
+      : streams(streams), slabs(slabs) {}
+
+  ogg_stream_state *Stream(int serialno) { return streams->Get(serialno); }
+
+  void Page(int serialno, ogg_page *og) {
+    Entry entry;
+    entry.page = true;
+    entry.serialno = serialno;
+    entry.slab = NULL;
+    entry.offset = pageData.size();
+    entry.og = *og;
+    pageData.insert(pageData.end(), og->header, og->header + og->header_len);
+    pageData.insert(pageData.end(), og->body, og->body + og->body_len);
+    entries.push_back(entry);
+  }
+
+  void Packet(int serialno, ogg_packet *op) {
+    Entry entry;
+    entry.page = false;
+    entry.serialno = serialno;
+    entry.op = *op;
+    entry.slab = slabs->Allocate(op->bytes, &entry.offset);
+    if (entry.slab) {
+      memcpy(entry.slab->data + entry.offset, op->packet, op->bytes);
+    } else {
+      entry.offset = data.size();
+      data.insert(data.end(), op->packet, op->packet + op->bytes);
+    }
+    entries.push_back(entry);
+  }
+
+  // the `ogg_page` / `ogg_packet` instance for `entry`, pages being views
+  // into `pages`, the ArrayBuffer `pageData` was moved into; main thread only
+  Napi::Object ToJS(Napi::Env env, Entry &entry, Napi::ArrayBuffer pages) {
+    Napi::Object obj;
+    if (entry.page) {
+      obj = OggPage::NewFromBuffers(
+          env, buffer_view(pages, entry.offset, entry.og.header_len),
+          buffer_view(pages, entry.offset + entry.og.header_len,
+                      entry.og.body_len));
+      obj.Set("packets", Napi::Number::New(env, ogg_page_packets(&entry.og)));
+    } else {
+      entry.op.packet = data.data() + entry.offset;
+      obj = slab_packet(env, &entry.op, entry.slab, entry.offset);
+    }
+    obj.Set("serialno", Napi::Number::New(env, entry.serialno));
+    return obj;
+  }
+
+  void Clear() {
+    entries.clear();
+    data.clear();
+    pageData.clear();
+  }
+
+  NativeStreams *streams;
+  SlabAllocator *slabs;
+  std::vector<Entry> entries;
+  std::vector<unsigned char> data;
+  std::vector<unsigned char> pageData;
+};
+
+static std::string demux_error(const char *call, int rtn) {
+  return std::string(call) + "() error: " + std::to_string(rtn);
+}
+
+/* Turns a `DemuxResult` into the Array of `ogg_page` / `ogg_packet` instances
+ * handed to JS. The demuxed chunk and the reassembled packets become external
+ * ArrayBuffers that all payloads are Buffer views into, so the memory is freed
+ * by the JS GC once the last page or packet referencing it is collected.
+ */
+static Napi::Array demux_result_entries(Napi::Env env, DemuxResult &result) {
+  Napi::ArrayBuffer data;
+  Napi::ArrayBuffer extra;
+
+  if (!result.extra.empty()) extra = external_array_buffer(env, result.extra);
+
+  Napi::Array entries = Napi::Array::New(env, result.entries.size());
+  for (size_t i = 0; i < result.entries.size(); i++) {
+    DemuxEntry &entry = result.entries[i];
+    if (!entry.reassembled && data.IsEmpty()) {
+      data = Napi::ArrayBuffer::New(
+          env, result.data, result.length,
+          [](Napi::Env, void *data) { free(data); });
+      result.data = NULL;
+    }
+
+    Napi::Object obj;
+    if (entry.page) {
+      obj = OggPage::NewFromBuffers(
+          env, buffer_view(data, entry.offset, entry.og.header_len),
+          buffer_view(data, entry.offset + entry.og.header_len,
+                      entry.og.body_len));
+      obj.Set("packets", Napi::Number::New(env, ogg_page_packets(&entry.og)));
+    } else {
+      obj = OggPacket::NewFromBuffer(
+          env, &entry.op,
+          buffer_view(entry.reassembled ? extra : data, entry.offset,
+                      entry.op.bytes));
+    }
+    obj.Set("serialno", Napi::Number::New(env, entry.serialno));
+    entries.Set(static_cast<uint32_t>(i), obj);
+  }
+
+  return entries;
+}
+
+// `ogg_stream_packetin()` for each packet of `batch`, stopping at the first
+// failure.
+static int stream_packetin_batch(ogg_stream_state *os,
+                                 const PacketBatchView &batch) {
+  ogg_packet op;
+  for (size_t i = 0; i < batch.Size(); i++) {
+    batch.Packet(i, &op);
+    int rtn = ogg_stream_packetin(os, &op);
+    if (rtn != 0) return rtn;
+  }
+  return 0;
+}
+
+/* Writes every packet of a `PacketBatch` to a `ogg_stream_state`. */
+class OggStreamPacketinBatchWorker : public Napi::AsyncWorker {
+ public:
+  OggStreamPacketinBatchWorker(ogg_stream_state *os, Napi::Object batch,
+                               const PacketBatchView &view,
+                               Napi::Function &callback)
+      : Napi::AsyncWorker(callback), os(os), view(view), rtn(0) {
+    batchRef = Napi::Persistent(batch);
+  }
+  ~OggStreamPacketinBatchWorker() {}
+
+  void Execute() { rtn = stream_packetin_batch(os, view); }
+
+  void OnOK() {
+    Napi::Env env = Env();
+
+    Callback().Call({Napi::Number::New(env, rtn)});
+  }
+
+ private:
+  ogg_stream_state *os;
+  PacketBatchView view;
+  int rtn;
+  Napi::ObjectReference batchRef;
+};
+
+void node_ogg_stream_packetin_batch(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  OggStreamState *streamState =
+      Napi::ObjectWrap<OggStreamState>::Unwrap(info[0].As<Napi::Object>());
+  Napi::Object batch = info[1].As<Napi::Object>();
+  Napi::Function cb = info[2].As<Napi::Function>();
+
+  PacketBatchView view;
+  const char *err = view.Init(batch);
+  if (err) {
+    Napi::TypeError::New(env, err).ThrowAsJavaScriptException();
+    return;
+  }
+  (new OggStreamPacketinBatchWorker(&streamState->os, batch, view, cb))
+      ->Queue();
+}
+
+Napi::Value node_ogg_stream_packetin_batch_sync(
+    const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  OggStreamState *streamState =
+      Napi::ObjectWrap<OggStreamState>::Unwrap(info[0].As<Napi::Object>());
+
+  PacketBatchView view;
+  const char *err = view.Init(info[1].As<Napi::Object>());
+  if (err) {
+    Napi::TypeError::New(env, err).ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  return Napi::Number::New(env,
+                           stream_packetin_batch(&streamState->os, view));
+}
+
+/* Packets given as lists of Buffers, in the form taken by
+ * `ogg_stream_iovecin()`. The Buffers aren't copied; `Add()` collects every
+ * one of them in an owner Array instead, so that referencing it keeps the
+ * payloads alive even if the caller's Arrays are modified.
+ */
+struct IovecPackets {
+  std::vector<ogg_iovec_t> iov;
+  std::vector<int> counts;  // number of `iov` entries in each packet
+  std::vector<long> e_o_s;
+  std::vector<ogg_int64_t> granulepos;
+  size_t bytes;
+
+  IovecPackets() : bytes(0) {}
+
+  // Appends a packet made up of the Buffers of the Array `buffers`. Returns
+  // NULL on success. Main thread only.
+  const char *Add(Napi::Array owner, Napi::Value buffers, long eos,
+                  ogg_int64_t granule) {
+    if (!buffers.IsArray()) return "packet must be an Array of Buffers";
+    Napi::Array array = buffers.As<Napi::Array>();
+    for (uint32_t i = 0; i < array.Length(); i++) {
+      Napi::Value value = array.Get(i);
+      if (!value.IsTypedArray()) return "packet must be an Array of Buffers";
+      Napi::TypedArrayOf<uint8_t> buffer =
+          value.As<Napi::TypedArrayOf<uint8_t>>();
+      ogg_iovec_t piece;
+      piece.iov_base = buffer.Data();
+      piece.iov_len = buffer.ByteLength();
+      iov.push_back(piece);
+      bytes += piece.iov_len;
+      owner.Set(owner.Length(), buffer);
+    }
+    counts.push_back(static_cast<int>(array.Length()));
+    e_o_s.push_back(eos);
+    granulepos.push_back(granule);
+    return NULL;
+  }
+
+  // `ogg_stream_iovecin()` for each packet, stopping at the first failure.
+  int Packetin(ogg_stream_state *os) {
+    ogg_iovec_t *pieces = iov.data();
+    for (size_t i = 0; i < counts.size(); i++) {
+      int rtn =
+          ogg_stream_iovecin(os, pieces, counts[i], e_o_s[i], granulepos[i]);
+      if (rtn != 0) return rtn;
+      pieces += counts[i];
+    }
+    return 0;
+  }
+};
+
+// Reads a granulepos given as a Number or as a BigInt that fits in 64 bits.
+// Returns false for anything else.
+static bool granulepos_value(Napi::Value value, ogg_int64_t *granulepos) {
+  if (value.IsNumber()) {
+    *granulepos = value.As<Napi::Number>().Int64Value();
+    return true;
+  }
+  napi_valuetype type;
+  if (napi_typeof(value.Env(), value, &type) != napi_ok || type != napi_bigint)
+    return false;
+  int64_t result;
+  bool lossless;
+  if (napi_get_value_bigint_int64(value.Env(), value, &result, &lossless) !=
+          napi_ok ||
+      !lossless)
+    return false;
+  *granulepos = result;
+  return true;
+}
+
+// Reads the `{ packet, e_o_s, granulepos }` objects of the Array `value` into
+// `packets`, where each `packet` is an Array of Buffers and a missing
+// `granulepos` means 0. Returns NULL on success.
+static const char *iovec_packets(Napi::Array owner, Napi::Value value,
+                                 IovecPackets &packets) {
+  if (!value.IsArray()) return "packets must be an Array";
+  Napi::Array array = value.As<Napi::Array>();
+  for (uint32_t i = 0; i < array.Length(); i++) {
+    Napi::Value entry = array.Get(i);
+    if (!entry.IsObject()) return "packets must be objects";
+    Napi::Object packet = entry.As<Napi::Object>();
+    Napi::Value given = packet.Get("granulepos");
+    ogg_int64_t granulepos = 0;
+    if (!given.IsUndefined() && !granulepos_value(given, &granulepos))
+      return "granulepos must be a Number or a BigInt";
+    const char *err =
+        packets.Add(owner, packet.Get("packet"),
+                    packet.Get("e_o_s").ToBoolean() ? 1 : 0, granulepos);
+    if (err) return err;
+  }
+  return NULL;
+}
+
+// Reads the `(buffers, e_o_s, granulepos)` arguments of a single packet.
+static const char *iovec_packet(const Napi::CallbackInfo &info,
+                                Napi::Array owner, IovecPackets &packets) {
+  ogg_int64_t granulepos;
+  if (!granulepos_value(info[3], &granulepos))
+    return "granulepos must be a Number or a BigInt";
+  return packets.Add(owner, info[1], info[2].ToBoolean() ? 1 : 0, granulepos);
+}
+
+/* Writes packets made up of several Buffers each to a `ogg_stream_state`. */
+class OggStreamIovecinWorker : public Napi::AsyncWorker {
+ public:
+  OggStreamIovecinWorker(ogg_stream_state *os, Napi::Array owner,
+                         IovecPackets &packets, Napi::Function &callback)
+      : Napi::AsyncWorker(callback), os(os), rtn(0) {
+    ownerRef = Napi::Persistent(owner);
+    std::swap(this->packets, packets);
+  }
+  ~OggStreamIovecinWorker() {}
+
+  void Execute() { rtn = packets.Packetin(os); }
+
+  void OnOK() {
+    Napi::Env env = Env();
+
+    Callback().Call({Napi::Number::New(env, rtn)});
+  }
+
+ private:
+  ogg_stream_state *os;
+  IovecPackets packets;
+  int rtn;
+  Napi::Reference<Napi::Array> ownerRef;
+};
+
+void node_ogg_stream_iovecin(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  OggStreamState *streamState =
+      Napi::ObjectWrap<OggStreamState>::Unwrap(info[0].As<Napi::Object>());
+  Napi::Function cb = info[4].As<Napi::Function>();
+
+  Napi::Array owner = Napi::Array::New(env);
+  IovecPackets packets;
+  const char *err = iovec_packet(info, owner, packets);
+  if (err) {
+    Napi::TypeError::New(env, err).ThrowAsJavaScriptException();
+    return;
+  }
+  (new OggStreamIovecinWorker(&streamState->os, owner, packets, cb))->Queue();
+}
+
+Napi::Value node_ogg_stream_iovecin_sync(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  OggStreamState *streamState =
+      Napi::ObjectWrap<OggStreamState>::Unwrap(info[0].As<Napi::Object>());
+
+  Napi::Array owner = Napi::Array::New(env);
+  IovecPackets packets;
+  const char *err = iovec_packet(info, owner, packets);
+  if (err) {
+    Napi::TypeError::New(env, err).ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  return Napi::Number::New(env, packets.Packetin(&streamState->os));
+}
+
+void node_ogg_stream_iovecin_batch(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  OggStreamState *streamState =
+      Napi::ObjectWrap<OggStreamState>::Unwrap(info[0].As<Napi::Object>());
+  Napi::Function cb = info[2].As<Napi::Function>();
+
+  Napi::Array owner = Napi::Array::New(env);
+  IovecPackets packets;
+  const char *err = iovec_packets(owner, info[1], packets);
+  if (err) {
+    Napi::TypeError::New(env, err).ThrowAsJavaScriptException();
+    return;
+  }
+  (new OggStreamIovecinWorker(&streamState->os, owner, packets, cb))->Queue();
+}
+
+Napi::Value node_ogg_stream_iovecin_batch_sync(
+    const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  OggStreamState *streamState =
+      Napi::ObjectWrap<OggStreamState>::Unwrap(info[0].As<Napi::Object>());
+
+  Napi::Array owner = Napi::Array::New(env);
+  IovecPackets packets;
+  const char *err = iovec_packets(owner, info[1], packets);
+  if (err) {
+    Napi::TypeError::New(env, err).ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  return Napi::Number::New(env, packets.Packetin(&streamState->os));
+}
+
+/* Pages produced by `stream_mux()`, laid out back to back in `data`. */
+struct MuxResult {
+  MuxResult() : eos(false), held(0) {}
+
+  std::vector<unsigned char> data;
+  std::vector<uint32_t> lengths;
+  std::vector<int64_t> granulepos;
+  bool eos;
+  // `os->refs.released` count at which the packets are no longer needed
+  int64_t held;
+};
+
+// `ogg_stream_packetin()` for each of `packets`, then `ogg_stream_pageout()`
+// (or `ogg_stream_flush()`) until no more pages come out, aiming for pages
+// of `nfill` bytes. With `zeroCopy`
+// the packets are submitted by reference instead, and their bodies are
+// copied straight into `result.data`; they must then stay alive until
+// `os->refs.released` reaches `result.held`.
+static int stream_mux(ogg_stream_state *os,
+                      const std::vector<ogg_packet> &packets, bool flush,
+                      bool zeroCopy, int nfill, MuxResult &result) {
+  int rtn = 0;
+  for (size_t i = 0; i < packets.size() && rtn == 0; i++) {
+    ogg_packet *op = const_cast<ogg_packet *>(&packets[i]);
+    rtn = zeroCopy ? ogg_stream_packetin_ref(os, op)
+                   : ogg_stream_packetin(os, op);
+  }
+  // also on failure, for the packets submitted before it
+  result.held = os->refs.released + (os->refs.fill - os->refs.returned);
+  if (rtn != 0) return rtn;
+
+  ogg_page og;
+  while (ogg_stream_pageout_ref_fill(os, &og, flush, nfill)) {
+    size_t offset = result.data.size();
+    result.data.resize(offset + og.header_len + og.body_len);
+    unsigned char *page = result.data.data() + offset;
+    if (og.body == NULL)
+      ogg_stream_gather(os, &og, page + og.header_len);
+    else
+      memcpy(page + og.header_len, og.body, og.body_len);
+    // after gathering, which sets the checksum
+    memcpy(page, og.header, og.header_len);
+    result.lengths.push_back(
+        static_cast<uint32_t>(og.header_len + og.body_len));
+    result.granulepos.push_back(ogg_page_granulepos(&og));
+    if (ogg_page_eos(&og)) result.eos = true;
+  }
+  return 0;
+}
+
+// Reads the packets out of an Array of `ogg_packet` instances or a
+// `PacketBatch`. Their payloads aren't copied. Returns NULL on success.
+static const char *mux_packets(Napi::Value value,
+                               std::vector<ogg_packet> &packets) {
+  if (value.IsArray()) {
+    Napi::Array array = value.As<Napi::Array>();
+    packets.resize(array.Length());
+    for (uint32_t i = 0; i < array.Length(); i++) {
+      Napi::Value packet = array.Get(i);
+      if (!OggPacket::IsInstance(packet))
+        return "packets must be ogg_packet instances";
+      packets[i] =
+          Napi::ObjectWrap<OggPacket>::Unwrap(packet.As<Napi::Object>())->op;
+    }
+    return NULL;
+  }
+
+  if (!value.IsObject()) return "packets must be an Array or a PacketBatch";
+  PacketBatchView batch;
+  const char *err = batch.Init(value.As<Napi::Object>());
+  if (err) return err;
+  packets.resize(batch.Size());
+  for (size_t i = 0; i < batch.Size(); i++) batch.Packet(i, &packets[i]);
+  return NULL;
+}
+
+// The `(rtn, data, lengths, granulepos, e_o_s)` arguments passed to the
+// `ogg_stream_mux` callback.
+static std::vector<napi_value> mux_result_values(Napi::Env env, int rtn,
+                                                 MuxResult &result) {
+  std::vector<napi_value> values;
+  values.push_back(Napi::Number::New(env, rtn));
+  if (rtn == 0) {
+    size_t length = result.data.size();
+    values.push_back(
+        buffer_view(external_array_buffer(env, result.data), 0, length));
+    values.push_back(typed_array(env, result.lengths, napi_uint32_array));
+    values.push_back(
+        typed_array(env, result.granulepos, napi_bigint64_array));
+    values.push_back(Napi::Boolean::New(env, result.eos));
+  } else {
+    for (int i = 0; i < 4; i++) values.push_back(env.Null());
+  }
+  return values;
+}
+
+// The object keeping the payloads read by `mux_packets()` alive: a private
+// Array of the Buffers they point into, so that emptying or reusing the
+// caller's Array, or assigning a new `packet` to an `ogg_packet`, doesn't
+// release a payload that is still to be read or is held by the stream. For a
+// `PacketBatch` that is its `data`.
+static Napi::Object mux_packets_owner(Napi::Value value) {
+  Napi::Env env = value.Env();
+  if (!value.IsArray()) {
+    Napi::Array owner = Napi::Array::New(env, 1);
+    owner.Set(0u, value.As<Napi::Object>().Get("data"));
+    return owner;
+  }
+  Napi::Array array = value.As<Napi::Array>();
+  Napi::Array owner = Napi::Array::New(env, array.Length());
+  for (uint32_t i = 0; i < array.Length(); i++) {
+    OggPacket *packet =
+        Napi::ObjectWrap<OggPacket>::Unwrap(array.Get(i).As<Napi::Object>());
+    if (!packet->jsBufferRef.IsEmpty())
+      owner.Set(i, packet->jsBufferRef.Value());
+  }
+  return owner;
+}
+
+// The optional `nfill` argument of `ogg_stream_mux`.
+static int mux_page_fill(Napi::Value value) {
+  if (!value.IsNumber()) return default_page_fill;
+  return value.As<Napi::Number>().Int32Value();
+}
+
+/* Writes a list of packets to a `ogg_stream_state` and pages them out. */
+class OggStreamMuxWorker : public Napi::AsyncWorker {
+ public:
+  OggStreamMuxWorker(OggStreamState *streamState, Napi::Object owner,
+                     std::vector<ogg_packet> &packets, bool flush,
+                     bool zeroCopy, int nfill, Napi::Function &callback)
+      : Napi::AsyncWorker(callback),
+        streamState(streamState),
+        flush(flush),
+        zeroCopy(zeroCopy),
+        nfill(nfill),
+        rtn(0) {
+    packetsRef = Napi::Persistent(owner);
+    this->packets.swap(packets);
+  }
+  ~OggStreamMuxWorker() {}
+
+  void Execute() {
+    rtn = stream_mux(&streamState->os, packets, flush, zeroCopy, nfill,
+                     result);
+  }
+
+  void OnOK() {
+    if (zeroCopy) streamState->Hold(result.held, packetsRef);
+    streamState->Release();
+    Callback().Call(mux_result_values(Env(), rtn, result));
+  }
+
+ private:
+  OggStreamState *streamState;
+  std::vector<ogg_packet> packets;
+  bool flush;
+  bool zeroCopy;
+  int nfill;
+  int rtn;
+  MuxResult result;
+  Napi::ObjectReference packetsRef;
+};
+
+/* Submits an Array of `ogg_packet` instances (or a `PacketBatch`) to a
+ * `ogg_stream_state` and then calls `ogg_stream_pageout()`, or
+ * `ogg_stream_flush()` when `flush` is true, until it returns 0. The callback
+ * gets every resulting page in a single Buffer, along with each page's length
+ * and granulepos and whether an "eos" page was among them.
+ *
+ * With `zeroCopy` the payloads are referenced rather than copied into the
+ * stream, and only copied once, into the pages. Packets still buffered
+ * afterwards are kept alive by the `ogg_stream_state` until they are paged
+ * out, and their payloads must not be modified in the meantime.
+ *
+ * `nfill` is the nominal page size, as for `ogg_stream_pageout_fill()`;
+ * anything but a Number means the default of `ogg_stream_pageout()`.
+ */
+void node_ogg_stream_mux(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  OggStreamState *streamState =
+      Napi::ObjectWrap<OggStreamState>::Unwrap(info[0].As<Napi::Object>());
+  bool flush = info[2].ToBoolean();
+  bool zeroCopy = info[3].ToBoolean();
+  int nfill = mux_page_fill(info[4]);
+  Napi::Function cb = info[5].As<Napi::Function>();
+
+  std::vector<ogg_packet> packets;
+  const char *err = mux_packets(info[1], packets);
+  if (err) {
+    Napi::TypeError::New(env, err).ThrowAsJavaScriptException();
+    return;
+  }
+  (new OggStreamMuxWorker(streamState, mux_packets_owner(info[1]), packets,
+                          flush, zeroCopy, nfill, cb))
+      ->Queue();
+}
+
+Napi::Value node_ogg_stream_mux_sync(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  OggStreamState *streamState =
+      Napi::ObjectWrap<OggStreamState>::Unwrap(info[0].As<Napi::Object>());
+  bool flush = info[2].ToBoolean();
+  bool zeroCopy = info[3].ToBoolean();
+  int nfill = mux_page_fill(info[4]);
+
+  std::vector<ogg_packet> packets;
+  const char *err = mux_packets(info[1], packets);
+  if (err) {
+    Napi::TypeError::New(env, err).ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  MuxResult result;
+  int rtn =
+      stream_mux(&streamState->os, packets, flush, zeroCopy, nfill, result);
+  if (zeroCopy) {
+    Napi::ObjectReference ref =
+        Napi::Persistent(mux_packets_owner(info[1]));
+    streamState->Hold(result.held, ref);
+  }
+  streamState->Release();
+  std::vector<napi_value> values = mux_result_values(env, rtn, result);
+  Napi::Array array = Napi::Array::New(env, values.size());
+  for (uint32_t i = 0; i < values.size(); i++) array.Set(i, values[i]);
+  return array;
+}
+
+// Reads the `(buffer, offset)` arguments of `ogg_scan_pages`.
+static bool scan_pages_args(const Napi::CallbackInfo &info,
+                            Napi::TypedArrayOf<uint8_t> *buffer,
+                            size_t *offset) {
+  Napi::Env env = info.Env();
+  if (!info[0].IsTypedArray() ||
+      info[0].As<Napi::TypedArray>().TypedArrayType() != napi_uint8_array) {
+    Napi::TypeError::New(env, "buffer must be a Buffer or Uint8Array")
+        .ThrowAsJavaScriptException();
+    return false;
+  }
+  *buffer = info[0].As<Napi::TypedArrayOf<uint8_t>>();
+  if (buffer->ByteLength() > PageScan::kMaxLength) {
+    Napi::RangeError::New(env, "buffer must be smaller than 4 GiB")
+        .ThrowAsJavaScriptException();
+    return false;
+  }
+
+  double start = info[1].IsNumber() ? info[1].As<Napi::Number>().DoubleValue()
+                                    : 0;
+  if (!(start >= 0) || start > buffer->ByteLength()) {
+    Napi::RangeError::New(env, "offset is outside of the buffer")
+        .ThrowAsJavaScriptException();
+    return false;
+  }
+  *offset = static_cast<size_t>(start);
+  return true;
+}
+
+class OggScanPagesWorker : public Napi::AsyncWorker {
+ public:
+  OggScanPagesWorker(Napi::TypedArrayOf<uint8_t> buffer, size_t offset,
+                     Napi::Function &callback)
+      : Napi::AsyncWorker(callback),
+        data(buffer.Data()),
+        length(buffer.ByteLength()),
+        offset(offset) {
+    bufferRef = Napi::Persistent(buffer.As<Napi::Object>());
+  }
+  ~OggScanPagesWorker() {}
+
+  void Execute() { scan.Scan(data, length, offset); }
+
+  void OnOK() {
+    Napi::Env env = Env();
+    Callback().Call({env.Null(), scan.ToJS(env)});
+  }
+
+ private:
+  const unsigned char *data;
+  size_t length;
+  size_t offset;
+  PageScan scan;
+  Napi::ObjectReference bufferRef;
+};
+
+/* Locates the Ogg pages in `buffer` from `offset` on, reading them in place
+ * instead of going through an `ogg_sync_state`. The callback gets the
+ * `PageScan` arrays: offset, length, serialno, granulepos, header flags and
+ * whether the checksum verified for each complete page, and `next`, the
+ * offset to resume from once more data follows the buffer.
+ */
+void node_ogg_scan_pages(const Napi::CallbackInfo &info) {
+  Napi::TypedArrayOf<uint8_t> buffer;
+  size_t offset;
+  if (!scan_pages_args(info, &buffer, &offset)) return;
+  Napi::Function cb = info[2].As<Napi::Function>();
+
+  (new OggScanPagesWorker(buffer, offset, cb))->Queue();
+}
+
+Napi::Value node_ogg_scan_pages_sync(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  Napi::TypedArrayOf<uint8_t> buffer;
+  size_t offset;
+  if (!scan_pages_args(info, &buffer, &offset)) return env.Undefined();
+
+  PageScan scan;
+  scan.Scan(buffer.Data(), buffer.ByteLength(), offset);
+  Napi::Array result = Napi::Array::New(env, 2);
+  result.Set(0u, env.Null());
+  result.Set(1u, scan.ToJS(env));
+  return result;
+}
+
+/* Returns the duration of each of the given Opus packets in 48 kHz samples,
+ * as an Int32Array, from their TOC bytes; -1 for packets that aren't valid.
+ * `packets` is an Array of Buffers or a `PacketBatch`. Only a byte or two of
+ * each packet is read, so there is no thread pool variant.
+ */
+Napi::Value node_opus_packet_durations(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  std::vector<int32_t> durations;
+
+  if (info[0].IsArray()) {
+    Napi::Array array = info[0].As<Napi::Array>();
+    durations.resize(array.Length());
+    for (uint32_t i = 0; i < array.Length(); i++) {
+      Napi::Value value = array.Get(i);
+      if (!value.IsTypedArray()) {
+        Napi::TypeError::New(env, "packets must be Buffers")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+      }
+      Napi::TypedArrayOf<uint8_t> packet =
+          value.As<Napi::TypedArrayOf<uint8_t>>();
+      durations[i] =
+          opus_packet_samples(packet.Data(), packet.ByteLength());
+    }
+    return typed_array(env, durations, napi_int32_array);
+  }
+
+  PacketBatchView batch;
+  const char *err = "packets must be an Array or a PacketBatch";
+  if (info[0].IsObject()) err = batch.Init(info[0].As<Napi::Object>());
+  if (err) {
+    Napi::TypeError::New(env, err).ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  durations.resize(batch.Size());
+  ogg_packet op;
+  for (size_t i = 0; i < batch.Size(); i++) {
+    batch.Packet(i, &op);
+    durations[i] =
+        opus_packet_samples(op.packet, static_cast<size_t>(op.bytes));
+  }
+  return typed_array(env, durations, napi_int32_array);
+}
+
+/* Demux sink keeping a separate `PacketBatch` per stream, in order of each
+ * stream's first packet. Pages aren't reported. */
+class StreamBatchSink {
+ public:
+  explicit StreamBatchSink(NativeStreams *streams) : streams(streams) {}
+
+  ogg_stream_state *Stream(int serialno) { return streams->Get(serialno); }
+  void Page(int, ogg_page *) {}
+
+  void Packet(int serialno, ogg_packet *op) {
+    std::map<int, PacketBatch>::iterator it = batches.find(serialno);
+    if (it == batches.end()) {
+      order.push_back(serialno);
+      it = batches.insert(std::make_pair(serialno, PacketBatch())).first;
+    }
+    it->second.Append(serialno, op);
+  }
+
+  void Clear() {
+    order.clear();
+    batches.clear();
+  }
+
+  NativeStreams *streams;
+  std::vector<int> order;
+  std::map<int, PacketBatch> batches;
+};
+
+/* Builds the `{ pages, groups }` object `ogg_decoder` hands to JS: every page
+ * in input order, and a `{ serialno, packets }` group per stream in order of
+ * first appearance. */
+class StreamGroups {
+ public:
+  explicit StreamGroups(Napi::Env env)
+      : env(env),
+        pages(Napi::Array::New(env)),
+        groups(Napi::Array::New(env)),
+        pageCount(0) {}
+
+  Napi::Object Group(int serialno) { return Lists(serialno).group; }
+
+  void Add(int serialno, bool page, Napi::Value value) {
+    if (page) {
+      pages.Set(pageCount++, value);
+      return;
+    }
+    GroupLists &lists = Lists(serialno);
+    lists.packets.Set(lists.packetCount++, value);
+  }
+
+  Napi::Object Value() {
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("pages", pages);
+    result.Set("groups", groups);
+    return result;
+  }
+
+ private:
+  struct GroupLists {
+    Napi::Object group;
+    Napi::Array packets;
+    uint32_t packetCount;
+  };
+
+  GroupLists &Lists(int serialno) {
+    std::map<int, GroupLists>::iterator it = index.find(serialno);
+    if (it != index.end()) return it->second;
+
+    GroupLists lists;
+    lists.group = Napi::Object::New(env);
+    lists.packets = Napi::Array::New(env);
+    lists.packetCount = 0;
+    lists.group.Set("serialno", Napi::Number::New(env, serialno));
+    lists.group.Set("packets", lists.packets);
+    groups.Set(groups.Length(), lists.group);
+    return index[serialno] = lists;
+  }
+
+  Napi::Env env;
+  Napi::Array pages;
+  Napi::Array groups;
+  uint32_t pageCount;
+  std::map<int, GroupLists> index;
+};
+
+// Maps the `verify` option of `ogg_decoder` to the `ogg_sync_verify()` policy
+// of its demuxing sync state, or -1 if it isn't one. "deferred" checks nothing
+// inline, see `OggDecoder::Verify()`.
+static int verify_policy(const std::string &name) {
+  if (name == "always") return OGG_VERIFY_ALWAYS;
+  if (name == "sampled") return OGG_VERIFY_SAMPLED;
+  if (name == "deferred" || name == "off") return OGG_VERIFY_NEVER;
+  return -1;
+}
+
+/* Native demuxer behind the JS `Decoder`. It owns the `ogg_sync_state` and an
+ * `ogg_stream_state` per serialno, and runs the whole sync/pagein/packetout
+ * loop for a written chunk in one call, on the thread pool or inline. JS gets
+ * back every page the chunk completed, in input order, and a single group per
+ * stream holding all of its packets, either as `ogg_packet` instances or,
+ * with the `batch` option, as the fields of a `PacketBatch` (no pages are
+ * reported then).
+ */
+class OggDecoder : public Napi::ObjectWrap<OggDecoder> {
+ public:
+  static void Init(Napi::Env env, Napi::Object exports) {
+    Napi::HandleScope scope(env);
+
+    Napi::Function func = DefineClass(
+        env, "ogg_decoder",
+        {InstanceMethod("write", &OggDecoder::write),
+         InstanceMethod("writeSync", &OggDecoder::writeSync),
+         InstanceMethod("verify", &OggDecoder::verify),
+         InstanceAccessor("ring", &OggDecoder::ring, nullptr,
+                          napi_enumerable)});
+
+    exports.Set("ogg_decoder", func);
+  }
+
+  OggDecoder(const Napi::CallbackInfo &info)
+      : Napi::ObjectWrap<OggDecoder>(info),
+        batch(false),
+        singleCopy(false),
+        verified(0),
+        packetSink(&streams, &slabs),
+        batchSink(&streams) {
+    ogg_sync_init(&oy);
+    ogg_sync_init(&verifier);
+
+    int policy = OGG_VERIFY_ALWAYS;
+    int interval = 16;
+    if (info[0].IsObject()) {
+      Napi::Object opts = info[0].As<Napi::Object>();
+      batch = opts.Get("batch").ToBoolean();
+      singleCopy = !batch && opts.Get("singleCopy").ToBoolean();
+      sync_ring_option(&oy, opts.Get("ring"));
+
+      Napi::Value verify = opts.Get("verify");
+      if (!verify.IsUndefined()) {
+        policy = verify_policy(verify.ToString());
+        if (policy < 0) {
+          Napi::TypeError::New(info.Env(),
+                               "verify must be \"always\", \"sampled\", "
+                               "\"deferred\" or \"off\"")
+              .ThrowAsJavaScriptException();
+          return;
+        }
+      }
+      Napi::Value verifyInterval = opts.Get("verifyInterval");
+      if (verifyInterval.IsNumber())
+        interval = verifyInterval.As<Napi::Number>().Int32Value();
+      if (policy == OGG_VERIFY_SAMPLED && interval < 1) {
+        Napi::TypeError::New(info.Env(), "verifyInterval must be at least 1")
+            .ThrowAsJavaScriptException();
+        return;
+      }
+    }
+    ogg_sync_verify(&oy, policy, interval);
+    views.pages = true;
+    views.verify = policy;
+    views.verifyInterval = interval;
+  }
+  ~OggDecoder() {
+    ogg_sync_clear(&oy);
+    ogg_sync_clear(&verifier);
+  }
+
+  // Demuxes `chunk` into the pending result; doesn't touch JS.
+  int Demux(const unsigned char *chunk, size_t length, const char **call) {
+    if (singleCopy) return views.Demux(chunk, length, viewResult, call);
+
+    *call = "ogg_sync_write";
+    int rtn = sync_write(&oy, chunk, length);
+    if (rtn != 0) return rtn;
+    if (batch) return demux_pages(&oy, batchSink, call);
+    return demux_pages(&oy, packetSink, call);
+  }
+
+  // Hands the pending result over to JS: the pages in input order, and the
+  // packets grouped by stream.
+  Napi::Object TakeGroups(Napi::Env env) {
+    StreamGroups groups(env);
+    if (batch) {
+      for (size_t i = 0; i < batchSink.order.size(); i++) {
+        int serialno = batchSink.order[i];
+        groups.Group(serialno).Set("packets",
+                                   batchSink.batches[serialno].ToJS(env));
+      }
+    } else if (singleCopy) {
+      Napi::Array entries = demux_result_entries(env, viewResult);
+      for (size_t i = 0; i < viewResult.entries.size(); i++) {
+        DemuxEntry &entry = viewResult.entries[i];
+        groups.Add(entry.serialno, entry.page,
+                   entries.Get(static_cast<uint32_t>(i)));
+      }
+    } else {
+      Napi::ArrayBuffer pages = external_array_buffer(env, packetSink.pageData);
+      for (size_t i = 0; i < packetSink.entries.size(); i++) {
+        NativeDemuxSink::Entry &entry = packetSink.entries[i];
+        groups.Add(entry.serialno, entry.page,
+                   packetSink.ToJS(env, entry, pages));
+      }
+      slabs.Collect();
+    }
+    Discard();
+    return groups.Value();
+  }
+
+  // Drops the pending result, i.e. after a failed `Demux()`.
+  void Discard() {
+    packetSink.Clear();
+    batchSink.Clear();
+    viewResult.Clear();
+  }
+
+  // The deferred checksum pass: runs `chunk` through a second sync state that
+  // verifies every page, independently of `Demux()`, and appends the input
+  // offset and length of each stretch that failed to verify to `ranges`.
+  // Chunks must be passed in the order they were demuxed, one at a time.
+  int Verify(const unsigned char *chunk, size_t length,
+             std::vector<double> &ranges) {
+    int rtn = sync_write(&verifier, chunk, length);
+    if (rtn != 0) return rtn;
+
+    long bytes;
+    while ((bytes = ogg_sync_pageseek(&verifier, NULL)) != 0) {
+      if (bytes < 0) {
+        bytes = -bytes;
+        size_t n = ranges.size();
+        if (n > 0 && ranges[n - 2] + ranges[n - 1] == verified) {
+          ranges[n - 1] += bytes;
+        } else {
+          ranges.push_back(verified);
+          ranges.push_back(static_cast<double>(bytes));
+        }
+      }
+      verified += bytes;
+    }
+    return 0;
+  }
+
+  // write(chunk, cb), `cb(err, { pages, groups })`
+  void write(const Napi::CallbackInfo &info);
+  // writeSync(chunk) returns `[err, { pages, groups }]`
+  Napi::Value writeSync(const Napi::CallbackInfo &info);
+  // verify(chunk, cb), always on the thread pool; `cb(err, ranges)` gets a
+  // Float64Array of `offset, length` pairs
+  void verify(const Napi::CallbackInfo &info);
+  // whether the sync buffer is a mapped ring, see `sync_ring_option()`
+  Napi::Value ring(const Napi::CallbackInfo &info) {
+    return Napi::Boolean::New(info.Env(), oy.ring != NULL);
+  }
+
+ private:
+  bool batch;
+  bool singleCopy;
+  ogg_sync_state oy;
+  ogg_sync_state verifier;
+  double verified;  // input bytes through the deferred checksum pass
+  NativeStreams streams;
+  SlabAllocator slabs;
+  NativeDemuxSink packetSink;
+  StreamBatchSink batchSink;
+  PageViewDemuxer views;
+  DemuxResult viewResult;
+};
+
+class OggDecoderWriteWorker : public Napi::AsyncWorker {
+ public:
+  OggDecoderWriteWorker(OggDecoder *decoder,
+                        Napi::TypedArrayOf<uint8_t> buffer,
+                        Napi::Function &callback)
+      : Napi::AsyncWorker(callback),
+        decoder(decoder),
+        data(buffer.Data()),
+        length(buffer.ByteLength()) {
+    decoderRef = Napi::Persistent(decoder->Value());
+    bufferRef = Napi::Persistent(buffer.As<Napi::Object>());
+  }
+  ~OggDecoderWriteWorker() {}
+
+  void Execute() {
+    const char *call = NULL;
+    int rtn = decoder->Demux(data, length, &call);
+    if (rtn != 0) SetError(demux_error(call, rtn));
+  }
+
+  void OnOK() {
+    Napi::Env env = Env();
+    Callback().Call({env.Null(), decoder->TakeGroups(env)});
+  }
+
+  void OnError(const Napi::Error &e) {
+    decoder->Discard();
+    Callback().Call({e.Value()});
+  }
+
+ private:
+  OggDecoder *decoder;
+  const unsigned char *data;
+  size_t length;
+  Napi::ObjectReference decoderRef;
+  Napi::ObjectReference bufferRef;
+};
+
+class OggDecoderVerifyWorker : public Napi::AsyncWorker {
+ public:
+  OggDecoderVerifyWorker(OggDecoder *decoder,
+                         Napi::TypedArrayOf<uint8_t> buffer,
+                         Napi::Function &callback)
+      : Napi::AsyncWorker(callback),
+        decoder(decoder),
+        data(buffer.Data()),
+        length(buffer.ByteLength()) {
+    decoderRef = Napi::Persistent(decoder->Value());
+    bufferRef = Napi::Persistent(buffer.As<Napi::Object>());
+  }
+  ~OggDecoderVerifyWorker() {}
+
+  void Execute() {
+    int rtn = decoder->Verify(data, length, ranges);
+    if (rtn != 0) SetError(demux_error("ogg_sync_write", rtn));
+  }
+
+  void OnOK() {
+    Napi::Env env = Env();
+    Callback().Call(
+        {env.Null(), typed_array(env, ranges, napi_float64_array)});
+  }
+
+ private:
+  OggDecoder *decoder;
+  const unsigned char *data;
+  size_t length;
+  std::vector<double> ranges;
+  Napi::ObjectReference decoderRef;
+  Napi::ObjectReference bufferRef;
+};
+
+void OggDecoder::verify(const Napi::CallbackInfo &info) {
+  Napi::TypedArrayOf<uint8_t> data = info[0].As<Napi::TypedArrayOf<uint8_t>>();
+  Napi::Function cb = info[1].As<Napi::Function>();
+
+  (new OggDecoderVerifyWorker(this, data, cb))->Queue();
+}
+
+void OggDecoder::write(const Napi::CallbackInfo &info) {
+  Napi::TypedArrayOf<uint8_t> data = info[0].As<Napi::TypedArrayOf<uint8_t>>();
+  Napi::Function cb = info[1].As<Napi::Function>();
+
+  (new OggDecoderWriteWorker(this, data, cb))->Queue();
+}
+
+Napi::Value OggDecoder::writeSync(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  Napi::TypedArrayOf<uint8_t> data = info[0].As<Napi::TypedArrayOf<uint8_t>>();
+
+  const char *call = NULL;
+  int rtn = Demux(data.Data(), data.ByteLength(), &call);
+
+  Napi::Array result = Napi::Array::New(env, 2);
+  if (rtn != 0) {
+    result.Set(0u, Napi::Error::New(env, demux_error(call, rtn)).Value());
+  } else {
+    result.Set(0u, env.Null());
+  }
+  result.Set(1u, TakeGroups(env));
+  return result;
 }
 
 }  // namespace nodeogg
 
 Napi::Object Init(Napi::Env env, Napi::Object exports) {
   using namespace nodeogg;
+  bufferFrom = Napi::Persistent(env.Global()
+                                    .Get("Buffer")
+                                    .As<Napi::Object>()
+                                    .Get("from")
+                                    .As<Napi::Function>());
+  bufferFrom.SuppressDestruct();
+
   OggSyncState::Init(env, exports);
   OggStreamState::Init(env, exports);
   OggPage::Init(env, exports);
   OggPacket::Init(env, exports);
+  OggDecoder::Init(env, exports);
 
   exports.Set(Napi::String::New(env, "ogg_sync_write"),
               Napi::Function::New(env, node_ogg_sync_write));
@@ -564,6 +2049,56 @@ Napi::Object Init(Napi::Env env, Napi::Object exports) {
               Napi::Function::New(env, node_ogg_stream_pageout));
   exports.Set(Napi::String::New(env, "ogg_stream_flush"),
               Napi::Function::New(env, node_ogg_stream_flush));
+  exports.Set(Napi::String::New(env, "ogg_stream_pageout_fill"),
+              Napi::Function::New(env, node_ogg_stream_pageout_fill));
+  exports.Set(Napi::String::New(env, "ogg_stream_flush_fill"),
+              Napi::Function::New(env, node_ogg_stream_flush_fill));
+  exports.Set(Napi::String::New(env, "ogg_stream_end"),
+              Napi::Function::New(env, node_ogg_stream_end));
+
+  // synchronous variants, run on the calling thread
+  exports.Set(Napi::String::New(env, "ogg_sync_writeSync"),
+              Napi::Function::New(env, node_ogg_sync_write_sync));
+  exports.Set(Napi::String::New(env, "ogg_sync_pageoutSync"),
+              Napi::Function::New(env, node_ogg_sync_pageout_sync));
+
+  exports.Set(Napi::String::New(env, "ogg_stream_pageinSync"),
+              Napi::Function::New(env, node_ogg_stream_pagein_sync));
+  exports.Set(Napi::String::New(env, "ogg_stream_packetoutSync"),
+              Napi::Function::New(env, node_ogg_stream_packetout_sync));
+  exports.Set(Napi::String::New(env, "ogg_stream_packetinSync"),
+              Napi::Function::New(env, node_ogg_stream_packetin_sync));
+  exports.Set(Napi::String::New(env, "ogg_stream_pageoutSync"),
+              Napi::Function::New(env, node_ogg_stream_pageout_sync));
+  exports.Set(Napi::String::New(env, "ogg_stream_flushSync"),
+              Napi::Function::New(env, node_ogg_stream_flush_sync));
+  exports.Set(Napi::String::New(env, "ogg_stream_pageout_fillSync"),
+              Napi::Function::New(env, node_ogg_stream_pageout_fill_sync));
+  exports.Set(Napi::String::New(env, "ogg_stream_flush_fillSync"),
+              Napi::Function::New(env, node_ogg_stream_flush_fill_sync));
+
+  exports.Set(Napi::String::New(env, "ogg_stream_packetin_batch"),
+              Napi::Function::New(env, node_ogg_stream_packetin_batch));
+  exports.Set(Napi::String::New(env, "ogg_stream_packetin_batchSync"),
+              Napi::Function::New(env, node_ogg_stream_packetin_batch_sync));
+  exports.Set(Napi::String::New(env, "ogg_stream_iovecin"),
+              Napi::Function::New(env, node_ogg_stream_iovecin));
+  exports.Set(Napi::String::New(env, "ogg_stream_iovecinSync"),
+              Napi::Function::New(env, node_ogg_stream_iovecin_sync));
+  exports.Set(Napi::String::New(env, "ogg_stream_iovecin_batch"),
+              Napi::Function::New(env, node_ogg_stream_iovecin_batch));
+  exports.Set(Napi::String::New(env, "ogg_stream_iovecin_batchSync"),
+              Napi::Function::New(env, node_ogg_stream_iovecin_batch_sync));
+  exports.Set(Napi::String::New(env, "ogg_stream_mux"),
+              Napi::Function::New(env, node_ogg_stream_mux));
+  exports.Set(Napi::String::New(env, "ogg_stream_muxSync"),
+              Napi::Function::New(env, node_ogg_stream_mux_sync));
+  exports.Set(Napi::String::New(env, "ogg_scan_pages"),
+              Napi::Function::New(env, node_ogg_scan_pages));
+  exports.Set(Napi::String::New(env, "ogg_scan_pagesSync"),
+              Napi::Function::New(env, node_ogg_scan_pages_sync));
+  exports.Set(Napi::String::New(env, "opus_packet_durations"),
+              Napi::Function::New(env, node_opus_packet_durations));
 
   return exports;
 }
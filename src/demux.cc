@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2020, Valyant AI
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "demux.hxx"
+
+namespace nodeogg {
+
+PageViewDemuxer::~PageViewDemuxer() { free(pending); }
+
+int PageViewDemuxer::Demux(const unsigned char *chunk, size_t length,
+                           DemuxResult &result, const char **call) {
+  // append the chunk to the unfinished page; growing geometrically keeps a
+  // page that trickles in over many small chunks linear to assemble
+  if (pendingFill + length > pendingStorage) {
+    size_t storage = pendingStorage * 2;
+    if (storage < pendingFill + length) storage = pendingFill + length;
+    unsigned char *grown =
+        static_cast<unsigned char *>(realloc(pending, storage));
+    if (grown == NULL) {
+      *call = "realloc";
+      return -1;
+    }
+    pending = grown;
+    pendingStorage = storage;
+  }
+  if (length > 0) memcpy(pending + pendingFill, chunk, length);
+  pendingFill += length;
+
+  // let libogg do the capture and checksum work in place, on a sync state
+  // that merely borrows our buffer
+  ogg_sync_state oy;
+  memset(&oy, 0, sizeof(oy));
+  oy.data = pending;
+  oy.storage = oy.fill = static_cast<int>(pendingFill);
+  ogg_sync_verify(&oy, verify, verifyInterval);
+  oy.verify_count = verifyCount;
+
+  ogg_page og;
+  long rtn;
+  bool captured = false;
+  while ((rtn = ogg_sync_pageseek(&oy, &og)) != 0) {
+    if (rtn < 0) continue;  // skipped some bytes while capturing sync
+    captured = true;
+
+    if (pages || ogg_page_bos(&og)) {
+      DemuxEntry entry;
+      entry.page = true;
+      entry.serialno = ogg_page_serialno(&og);
+      entry.reassembled = false;
+      entry.offset = og.header - pending;
+      entry.og = og;
+      result.entries.push_back(entry);
+    }
+
+    int r = Pagein(&og, pending, result);
+    if (r != 0) {
+      *call = "ogg_stream_pagein";
+      return r;
+    }
+  }
+  verifyCount = oy.verify_count;
+
+  size_t returned = static_cast<size_t>(oy.returned);
+  size_t tail = pendingFill - returned;
+  if (!captured) {
+    // still inside the first page; keep growing it in place
+    if (returned > 0) memmove(pending, pending + returned, tail);
+    pendingFill = tail;
+    return 0;
+  }
+
+  // hand the whole pages over, and start a new buffer with the start of the
+  // next one, so every input byte is copied at most twice
+  unsigned char *next = NULL;
+  if (tail > 0) {
+    next = static_cast<unsigned char *>(malloc(tail));
+    if (next == NULL) {
+      *call = "malloc";
+      return -1;
+    }
+    memcpy(next, pending + returned, tail);
+  }
+  unsigned char *data =
+      static_cast<unsigned char *>(realloc(pending, returned));
+  result.data = data != NULL ? data : pending;
+  result.length = returned;
+  pending = next;
+  pendingFill = pendingStorage = tail;
+  return 0;
+}
+
+/* Mirrors `ogg_stream_pagein()` followed by `ogg_stream_packetout()` until it
+ * runs dry, minus the copy into `os->body_data`. */
+int PageViewDemuxer::Pagein(ogg_page *og, const unsigned char *base,
+                            DemuxResult &result) {
+  unsigned char *header = og->header;
+  unsigned char *body = og->body;
+  int serialno = ogg_page_serialno(og);
+  int bos = ogg_page_bos(og) ? 0x100 : 0;
+  int eos = ogg_page_eos(og);
+  ogg_int64_t granulepos = ogg_page_granulepos(og);
+  long pageno = ogg_page_pageno(og);
+  int segments = header[26];
+  int segptr = 0;
+  int last = -1;
+
+  if (ogg_page_version(og) > 0) return -1;
+
+  Stream &s = streams[serialno];
+
+  /* are we in sequence? if not, drop the partial packet (if any) and count
+     the gap as a packet, like the hole marker in `_packetout()` does */
+  if (pageno != s.pageno) {
+    s.continuing = false;
+    s.bos = false;
+    s.partial.clear();
+    s.packetno++;
+  }
+
+  /* a 'continued packet' page whose start we never saw; skip its tail */
+  if (ogg_page_continued(og) && !s.continuing) {
+    bos = 0;
+    for (; segptr < segments; segptr++) {
+      int val = header[27 + segptr];
+      body += val;
+      if (val < 255) {
+        segptr++;
+        break;
+      }
+    }
+  }
+
+  /* the granulepos goes on the last packet completed on this page */
+  for (int i = segptr; i < segments; i++)
+    if (header[27 + i] < 255) last = i;
+
+  size_t start = 0;
+  size_t bytes = 0;
+  for (int i = segptr; i < segments; i++) {
+    int val = header[27 + i];
+    bytes += val;
+    if (val == 255) continue;
+
+    DemuxEntry entry;
+    entry.page = false;
+    entry.serialno = serialno;
+    if (s.continuing) {
+      entry.reassembled = true;
+      entry.offset = result.extra.size();
+      result.extra.insert(result.extra.end(), s.partial.begin(),
+                          s.partial.end());
+      result.extra.insert(result.extra.end(), body + start,
+                          body + start + bytes);
+      entry.op.packet = NULL;
+      entry.op.bytes = static_cast<long>(s.partial.size() + bytes);
+      entry.op.b_o_s = s.bos ? 0x100 : 0;
+      s.continuing = false;
+      s.bos = false;
+      s.partial.clear();
+    } else {
+      entry.reassembled = false;
+      entry.offset = body + start - base;
+      entry.op.packet = body + start;
+      entry.op.bytes = static_cast<long>(bytes);
+      entry.op.b_o_s = bos;
+    }
+    entry.op.e_o_s = eos && i == segments - 1 ? 0x200 : 0;
+    entry.op.granulepos = i == last ? granulepos : -1;
+    entry.op.packetno = s.packetno++;
+    result.entries.push_back(entry);
+
+    bos = 0;
+    start += bytes;
+    bytes = 0;
+  }
+
+  /* the last segment is a lacing value of 255, the packet goes on */
+  if (segptr < segments && header[27 + segments - 1] == 255) {
+    if (!s.continuing) {
+      s.continuing = true;
+      s.bos = bos != 0;
+    }
+    s.partial.insert(s.partial.end(), body + start, body + start + bytes);
+  }
+
+  s.pageno = pageno + 1;
+  return 0;
+}
+
+}  // namespace nodeogg
@@ -0,0 +1,166 @@
+#ifndef DEMUX_HXX
+#define DEMUX_HXX
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <map>
+#include <vector>
+
+#include "ogg/ogg.h"
+
+namespace nodeogg {
+
+/* combination of "ogg_sync_buffer", "memcpy", and "ogg_sync_wrote". The copy
+ * also takes the running CRC, so `ogg_sync_pageout()` verifies pages without
+ * reading their bodies again. */
+static inline int sync_write(ogg_sync_state *oy, const unsigned char *data,
+                             size_t length) {
+  return ogg_sync_write(oy, data, (long)length);
+}
+
+/* Drains every page currently buffered in `oy`: each page is submitted to the
+ * `ogg_stream_state` of its serialno and all of the packets it completes are
+ * read back out.
+ *
+ * `Sink` must provide:
+ *
+ *   ogg_stream_state *Stream(int serialno);  // NULL aborts the demux
+ *   void Page(int serialno, ogg_page *og);
+ *   void Packet(int serialno, ogg_packet *op);
+ *
+ * The page and packet pointers are only valid for the duration of the call.
+ * Returns 0 on success, otherwise the failing return value with `*call` set
+ * to the name of the libogg function that failed.
+ */
+template <typename Sink>
+int demux_pages(ogg_sync_state *oy, Sink &sink, const char **call) {
+  ogg_page og;
+  ogg_packet op;
+  int rtn;
+
+  for (;;) {
+    rtn = ogg_sync_pageout(oy, &og);
+    if (rtn == 0) break;    // need more data
+    if (rtn < 0) continue;  // skipped some bytes while capturing sync
+
+    int serialno = ogg_page_serialno(&og);
+    ogg_stream_state *os = sink.Stream(serialno);
+    if (os == NULL) {
+      *call = "ogg_stream_init";
+      return -1;
+    }
+
+    sink.Page(serialno, &og);
+
+    rtn = ogg_stream_pagein(os, &og);
+    if (rtn != 0) {
+      *call = "ogg_stream_pagein";
+      return rtn;
+    }
+
+    while ((rtn = ogg_stream_packetout(os, &op)) != 0) {
+      if (rtn < 0) continue;  // hole in the data, keep reading
+      sink.Packet(serialno, &op);
+    }
+  }
+
+  return 0;
+}
+
+/* A page or packet produced by `PageViewDemuxer`. Payloads are described by
+ * an offset into either the demuxed chunk (`DemuxResult::data`) or, for
+ * packets that had to be reassembled across pages, `DemuxResult::extra`.
+ * `op.packet` is left unset for reassembled packets since `extra` may still
+ * move while it grows.
+ */
+struct DemuxEntry {
+  bool page;
+  int serialno;
+  bool reassembled;
+  size_t offset;
+  ogg_page og;
+  ogg_packet op;
+};
+
+struct DemuxResult {
+  DemuxResult() : data(NULL), length(0) {}
+  ~DemuxResult() { free(data); }
+
+  // releases everything, so the result can be passed to `Demux()` again
+  void Clear() {
+    free(data);
+    data = NULL;
+    length = 0;
+    extra.clear();
+    entries.clear();
+  }
+
+  // the chunk all non-reassembled payloads point into; whoever exposes it to
+  // JS takes ownership by setting `data` to NULL
+  unsigned char *data;
+  size_t length;
+  std::vector<unsigned char> extra;
+  std::vector<DemuxEntry> entries;
+};
+
+/* Single-copy demuxer. Chunks are appended to one growable buffer until it
+ * holds at least one whole page; the whole pages are then handed to the
+ * caller, and only the start of the next page is copied into a new buffer.
+ * Packets contained in a single page are returned as offsets into the handed
+ * over buffer; only packets spanning pages are copied, into
+ * `DemuxResult::extra`. Packet numbering, flags and granulepos follow
+ * `ogg_stream_packetout()`, but no `ogg_stream_state` is involved.
+ */
+class PageViewDemuxer {
+ public:
+  PageViewDemuxer()
+      : pages(false),
+        verify(OGG_VERIFY_ALWAYS),
+        verifyInterval(0),
+        verifyCount(0),
+        pending(NULL),
+        pendingFill(0),
+        pendingStorage(0) {}
+  ~PageViewDemuxer();
+
+  // returns 0 on success or the failing return value, with `*call` set; when
+  // no page was completed `result.data` is left NULL
+  int Demux(const unsigned char *chunk, size_t length, DemuxResult &result,
+            const char **call);
+
+  // report every page as an entry, not just "bos" pages
+  bool pages;
+
+  // checksum policy, as for `ogg_sync_verify()`
+  int verify;
+  int verifyInterval;
+
+ private:
+  struct Stream {
+    Stream() : pageno(0), packetno(0), continuing(false), bos(false) {}
+
+    long pageno;  // next expected page sequence number
+    ogg_int64_t packetno;
+    bool continuing;  // a packet begun on an earlier page is still open
+    bool bos;         // ...and it is the first packet of the stream
+    std::vector<unsigned char> partial;
+  };
+
+  int Pagein(ogg_page *og, const unsigned char *base, DemuxResult &result);
+
+  std::map<int, Stream> streams;
+  int verifyCount;  // carried over between the per-chunk sync states
+
+  // the unfinished page, and anything after it
+  unsigned char *pending;
+  size_t pendingFill;
+  size_t pendingStorage;
+
+  PageViewDemuxer(const PageViewDemuxer &);
+  PageViewDemuxer &operator=(const PageViewDemuxer &);
+};
+
+}  // namespace nodeogg
+
+#endif
@@ -3,6 +3,9 @@
 
 #include <napi.h>
 
+#include <deque>
+#include <utility>
+
 #include "ogg/ogg.h"
 
 namespace nodeogg {
@@ -14,6 +17,11 @@ class OggSyncState : public Napi::ObjectWrap<OggSyncState> {
   OggSyncState(const Napi::CallbackInfo &info);
   ~OggSyncState();
 
+  // number of times libogg has reallocated the buffer of `oy`
+  Napi::Value reallocs(const Napi::CallbackInfo &info);
+  // whether `oy` is backed by a ring buffer
+  Napi::Value ring(const Napi::CallbackInfo &info);
+
   ogg_sync_state oy;
 
  private:
@@ -28,16 +36,33 @@ class OggStreamState : public Napi::ObjectWrap<OggStreamState> {
   OggStreamState(const Napi::CallbackInfo &info);
   ~OggStreamState();
 
+  // number of times libogg has reallocated the buffers of `os`
+  Napi::Value reallocs(const Napi::CallbackInfo &info);
+
+  // Keeps the packets behind `ref` alive until `os.refs.released` reaches
+  // `end`, i.e. until every body they submitted through
+  // `ogg_stream_packetin_ref()` has been paged out.
+  void Hold(int64_t end, Napi::ObjectReference &ref);
+  // lets go of the packets that have been paged out completely
+  void Release();
+
   ogg_stream_state os;
 
  private:
   static Napi::FunctionReference constructor;
+  std::deque<std::pair<int64_t, Napi::ObjectReference>> held;
 };
 
 class OggPage : public Napi::ObjectWrap<OggPage> {
  public:
   static void Init(Napi::Env env, Napi::Object exports);
   static Napi::Object NewInstance(Napi::Value arg);
+  // new `ogg_page` instance owning a copy of `og`'s header and body
+  static Napi::Object NewCopy(Napi::Env env, const ogg_page *og);
+  // new `ogg_page` instance referencing the given header and body
+  static Napi::Object NewFromBuffers(Napi::Env env,
+                                     Napi::TypedArrayOf<uint8_t> header,
+                                     Napi::TypedArrayOf<uint8_t> body);
 
   OggPage(const Napi::CallbackInfo &info);
   ~OggPage();
@@ -61,6 +86,13 @@ class OggPacket : public Napi::ObjectWrap<OggPacket> {
  public:
   static void Init(Napi::Env env, Napi::Object exports);
   static Napi::Object NewInstance(Napi::Value arg);
+  // new `ogg_packet` instance owning a copy of `op`'s payload
+  static Napi::Object NewCopy(Napi::Env env, const ogg_packet *op);
+  // new `ogg_packet` instance with `op`'s metadata, referencing `data`
+  static Napi::Object NewFromBuffer(Napi::Env env, const ogg_packet *op,
+                                    Napi::TypedArrayOf<uint8_t> data);
+  // whether `value` is an `ogg_packet` instance, and so safe to `Unwrap()`
+  static bool IsInstance(Napi::Value value);
 
   OggPacket(const Napi::CallbackInfo &info);
   ~OggPacket();
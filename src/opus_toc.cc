@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2020, Valyant AI
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include "opus_toc.hxx"
+
+namespace nodeogg {
+
+// 120 ms, the longest packet RFC 6716 allows
+static const int kMaxSamples = 5760;
+
+int opus_packet_samples(const unsigned char *data, size_t length) {
+  if (length < 1) return -1;
+  unsigned char toc = data[0];
+  int config = toc >> 3;
+
+  // frame size by configuration: SILK-only 10/20/40/60 ms, hybrid 10/20 ms
+  // and CELT-only 2.5/5/10/20 ms
+  static const int silk[4] = {480, 960, 1920, 2880};
+  int frame;
+  if (config < 12)
+    frame = silk[config & 3];
+  else if (config < 16)
+    frame = 480 << (config & 1);
+  else
+    frame = 120 << (config & 3);
+
+  int frames;
+  switch (toc & 3) {
+    case 0:
+      frames = 1;
+      break;
+    case 1:
+    case 2:
+      frames = 2;
+      break;
+    default:
+      if (length < 2) return -1;
+      frames = data[1] & 0x3f;
+      if (frames == 0) return -1;
+      break;
+  }
+
+  int samples = frames * frame;
+  return samples > kMaxSamples ? -1 : samples;
+}
+
+}  // namespace nodeogg
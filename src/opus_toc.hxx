@@ -0,0 +1,18 @@
+#ifndef OPUS_TOC_HXX
+#define OPUS_TOC_HXX
+
+#include <stddef.h>
+
+namespace nodeogg {
+
+/* Duration of an Opus packet in 48 kHz samples, read from its TOC byte (and,
+ * for code 3 packets, the frame count byte) as described in RFC 6716 section
+ * 3.1. This is what the packet advances the granulepos of an Ogg Opus
+ * stream by (RFC 7845). Returns -1 for packets that are empty, truncated, or
+ * longer than the 120 ms Opus allows.
+ */
+int opus_packet_samples(const unsigned char *data, size_t length);
+
+}  // namespace nodeogg
+
+#endif
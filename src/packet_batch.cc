@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2020, Valyant AI
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "packet_batch.hxx"
+
+#include <string.h>
+
+namespace nodeogg {
+
+Napi::ArrayBuffer external_array_buffer(Napi::Env env,
+                                        std::vector<unsigned char> &bytes) {
+  if (bytes.empty()) return Napi::ArrayBuffer::New(env, 0);
+
+  std::vector<unsigned char> *owned = new std::vector<unsigned char>();
+  owned->swap(bytes);
+  return Napi::ArrayBuffer::New(
+      env, owned->data(), owned->size(),
+      [](Napi::Env, void *, std::vector<unsigned char> *owned) {
+        delete owned;
+      },
+      owned);
+}
+
+void PacketBatch::Append(int serial, const ogg_packet *op) {
+  serialno.push_back(serial);
+  offsets.push_back(static_cast<uint32_t>(data.size()));
+  lengths.push_back(static_cast<uint32_t>(op->bytes));
+  b_o_s.push_back(op->b_o_s ? 1 : 0);
+  e_o_s.push_back(op->e_o_s ? 1 : 0);
+  granulepos.push_back(op->granulepos);
+  packetno.push_back(op->packetno);
+  data.insert(data.end(), op->packet, op->packet + op->bytes);
+}
+
+void PacketBatch::Clear() {
+  data.clear();
+  serialno.clear();
+  offsets.clear();
+  lengths.clear();
+  b_o_s.clear();
+  e_o_s.clear();
+  granulepos.clear();
+  packetno.clear();
+}
+
+Napi::Object PacketBatch::ToJS(Napi::Env env) {
+  Napi::Object batch = Napi::Object::New(env);
+
+  // the payloads are handed over without a copy
+  batch.Set("data", external_array_buffer(env, data));
+
+  batch.Set("serialno", typed_array(env, serialno, napi_int32_array));
+  batch.Set("offsets", typed_array(env, offsets, napi_uint32_array));
+  batch.Set("lengths", typed_array(env, lengths, napi_uint32_array));
+  batch.Set("b_o_s", typed_array(env, b_o_s, napi_uint8_array));
+  batch.Set("e_o_s", typed_array(env, e_o_s, napi_uint8_array));
+  batch.Set("granulepos", typed_array(env, granulepos, napi_bigint64_array));
+  batch.Set("packetno", typed_array(env, packetno, napi_bigint64_array));
+
+  Clear();
+  return batch;
+}
+
+PacketBatchView::PacketBatchView()
+    : count(0),
+      data(NULL),
+      length(0),
+      offsets(NULL),
+      lengths(NULL),
+      b_o_s(NULL),
+      e_o_s(NULL),
+      granulepos(NULL),
+      packetno(NULL) {}
+
+// Returns the typed array `batch[name]` if it is of the given type and has
+// `count` elements (or sets `count` when it is still unknown).
+template <typename T>
+static const T *typed_array_field(Napi::Object batch, const char *name,
+                                  napi_typedarray_type type, size_t *count) {
+  Napi::Value value = batch.Get(name);
+  if (!value.IsTypedArray()) return NULL;
+  Napi::TypedArray array = value.As<Napi::TypedArray>();
+  if (array.TypedArrayType() != type) return NULL;
+  if (*count == static_cast<size_t>(-1)) *count = array.ElementLength();
+  if (array.ElementLength() != *count) return NULL;
+  return value.As<Napi::TypedArrayOf<T>>().Data();
+}
+
+const char *PacketBatchView::Init(Napi::Object batch) {
+  Napi::Value value = batch.Get("data");
+  if (value.IsArrayBuffer()) {
+    Napi::ArrayBuffer arrayBuffer = value.As<Napi::ArrayBuffer>();
+    data = static_cast<const unsigned char *>(arrayBuffer.Data());
+    length = arrayBuffer.ByteLength();
+  } else if (value.IsTypedArray()) {
+    Napi::TypedArray array = value.As<Napi::TypedArray>();
+    data = static_cast<const unsigned char *>(array.ArrayBuffer().Data()) +
+           array.ByteOffset();
+    length = array.ByteLength();
+  } else {
+    return "batch.data must be an ArrayBuffer";
+  }
+
+  count = static_cast<size_t>(-1);
+  offsets = typed_array_field<uint32_t>(batch, "offsets", napi_uint32_array,
+                                        &count);
+  lengths = typed_array_field<uint32_t>(batch, "lengths", napi_uint32_array,
+                                        &count);
+  b_o_s = typed_array_field<uint8_t>(batch, "b_o_s", napi_uint8_array, &count);
+  e_o_s = typed_array_field<uint8_t>(batch, "e_o_s", napi_uint8_array, &count);
+  granulepos = typed_array_field<int64_t>(batch, "granulepos",
+                                          napi_bigint64_array, &count);
+  packetno = typed_array_field<int64_t>(batch, "packetno", napi_bigint64_array,
+                                        &count);
+  if (!offsets || !lengths || !b_o_s || !e_o_s || !granulepos || !packetno) {
+    count = 0;
+    return "batch fields must be typed arrays of equal length";
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    if (offsets[i] > length || lengths[i] > length - offsets[i]) {
+      count = 0;
+      return "batch packet out of bounds of batch.data";
+    }
+  }
+  return NULL;
+}
+
+void PacketBatchView::Packet(size_t i, ogg_packet *op) const {
+  op->packet = const_cast<unsigned char *>(data + offsets[i]);
+  op->bytes = lengths[i];
+  op->b_o_s = b_o_s[i];
+  op->e_o_s = e_o_s[i];
+  op->granulepos = granulepos[i];
+  op->packetno = packetno[i];
+}
+
+}  // namespace nodeogg
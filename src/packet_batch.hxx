@@ -0,0 +1,90 @@
+#ifndef PACKET_BATCH_HXX
+#define PACKET_BATCH_HXX
+
+#include <napi.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+#include "ogg/ogg.h"
+
+namespace nodeogg {
+
+// Copies `values` into a new typed array of the given type.
+template <typename T>
+inline Napi::TypedArrayOf<T> typed_array(Napi::Env env,
+                                         const std::vector<T> &values,
+                                         napi_typedarray_type type) {
+  Napi::ArrayBuffer arrayBuffer =
+      Napi::ArrayBuffer::New(env, values.size() * sizeof(T));
+  if (!values.empty())
+    memcpy(arrayBuffer.Data(), values.data(), values.size() * sizeof(T));
+  return Napi::TypedArrayOf<T>::New(env, values.size(), arrayBuffer, 0, type);
+}
+
+// Moves `bytes` into a new ArrayBuffer without copying, leaving it empty.
+Napi::ArrayBuffer external_array_buffer(Napi::Env env,
+                                        std::vector<unsigned char> &bytes);
+
+/* Native side of the JS `PacketBatch` class: all payloads packed into one
+ * buffer plus parallel arrays of per-packet metadata, so that a whole chunk
+ * worth of packets crosses into JS as a handful of typed arrays instead of
+ * one `ogg_packet` instance each. Builds on any thread; `ToJS()` is main
+ * thread only.
+ */
+class PacketBatch {
+ public:
+  size_t Size() const { return offsets.size(); }
+  size_t Bytes() const { return data.size(); }
+
+  void Append(int serialno, const ogg_packet *op);
+  void Clear();
+
+  // Moves the batch into a new `{ data, serialno, offsets, lengths, b_o_s,
+  // e_o_s, granulepos, packetno }` object, leaving this batch empty.
+  Napi::Object ToJS(Napi::Env env);
+
+ private:
+  std::vector<unsigned char> data;
+  std::vector<int32_t> serialno;
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> lengths;
+  std::vector<uint8_t> b_o_s;
+  std::vector<uint8_t> e_o_s;
+  std::vector<int64_t> granulepos;
+  std::vector<int64_t> packetno;
+};
+
+/* Borrowed view of a JS `PacketBatch`. The pointers stay valid for as long as
+ * the JS object is referenced, so the view may be used from the thread pool.
+ */
+class PacketBatchView {
+ public:
+  PacketBatchView();
+
+  // Returns NULL on success, otherwise a description of what's wrong with
+  // `batch`. Main thread only.
+  const char *Init(Napi::Object batch);
+
+  size_t Size() const { return count; }
+  size_t Bytes() const { return length; }
+
+  // points `op` at packet `i`; the payload is not copied
+  void Packet(size_t i, ogg_packet *op) const;
+
+ private:
+  size_t count;
+  const unsigned char *data;
+  size_t length;
+  const uint32_t *offsets;
+  const uint32_t *lengths;
+  const uint8_t *b_o_s;
+  const uint8_t *e_o_s;
+  const int64_t *granulepos;
+  const int64_t *packetno;
+};
+
+}  // namespace nodeogg
+
+#endif
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2020, Valyant AI
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include "page_scan.hxx"
+
+#include "ogg/ogg.h"
+#include "packet_batch.hxx"
+
+namespace nodeogg {
+
+// most that is handed to `ogg_page_scan()` at once, since it takes a `long`;
+// far more than any page
+static const size_t kMaxScan = 0x40000000;
+
+void PageScan::Scan(const unsigned char *data, size_t length, size_t offset) {
+  // one page per 4 KiB is typical for audio, larger pages only waste a little
+  size_t expected = (length - offset) / 4096 + 1;
+  offsets.reserve(expected);
+  lengths.reserve(expected);
+  serialno.reserve(expected);
+  granulepos.reserve(expected);
+  flags.reserve(expected);
+  crc.reserve(expected);
+
+  size_t pos = offset;
+  while (pos < length) {
+    size_t remaining = length - pos;
+    if (remaining > kMaxScan) remaining = kMaxScan;
+
+    ogg_page og;
+    int crcOk = 0;
+    long rtn = ogg_page_scan(data + pos, static_cast<long>(remaining), &og,
+                             &crcOk);
+    if (rtn < 0) {
+      pos += static_cast<size_t>(-rtn);
+      continue;
+    }
+    if (rtn == 0) break;  // page continues past the end of the buffer
+
+    offsets.push_back(static_cast<uint32_t>(pos));
+    lengths.push_back(static_cast<uint32_t>(rtn));
+    serialno.push_back(ogg_page_serialno(&og));
+    granulepos.push_back(ogg_page_granulepos(&og));
+    flags.push_back(og.header[5]);
+    crc.push_back(crcOk ? 1 : 0);
+    pos += crcOk ? static_cast<size_t>(rtn) : 1;
+  }
+  next = pos;
+}
+
+Napi::Object PageScan::ToJS(Napi::Env env) {
+  Napi::Object result = Napi::Object::New(env);
+  result.Set("offsets", typed_array(env, offsets, napi_uint32_array));
+  result.Set("lengths", typed_array(env, lengths, napi_uint32_array));
+  result.Set("serialno", typed_array(env, serialno, napi_int32_array));
+  result.Set("granulepos", typed_array(env, granulepos, napi_bigint64_array));
+  result.Set("flags", typed_array(env, flags, napi_uint8_array));
+  result.Set("crc", typed_array(env, crc, napi_uint8_array));
+  result.Set("next", Napi::Number::New(env, static_cast<double>(next)));
+  return result;
+}
+
+}  // namespace nodeogg
@@ -0,0 +1,48 @@
+#ifndef PAGE_SCAN_HXX
+#define PAGE_SCAN_HXX
+
+#include <napi.h>
+#include <stdint.h>
+
+#include <vector>
+
+namespace nodeogg {
+
+/* Result of `ogg_scan_pages`: every complete page found in a buffer, as
+ * parallel arrays indexed by page. Pages are located with `ogg_page_scan()`
+ * straight from the caller's memory, so nothing is copied or allocated per
+ * page beyond the amortized growth of the arrays. Scans on any thread;
+ * `ToJS()` is main thread only.
+ */
+class PageScan {
+ public:
+  PageScan() : next(0) {}
+
+  // `offsets` are 32-bit, so only buffers of up to this many bytes are
+  // accepted
+  static const size_t kMaxLength = 0xffffffffu;
+
+  // Scans `data[offset, length)`, with `length` at most `kMaxLength`. A page whose checksum fails is reported
+  // with `crc` 0, and the scan resumes one byte after its capture pattern, the
+  // way `ogg_sync_pageseek()` resyncs.
+  void Scan(const unsigned char *data, size_t length, size_t offset);
+
+  // Moves the result into a new `{ offsets, lengths, serialno, granulepos,
+  // flags, crc, next }` object.
+  Napi::Object ToJS(Napi::Env env);
+
+  // where a page was left incomplete, or `length` if none was
+  size_t next;
+
+ private:
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> lengths;
+  std::vector<int32_t> serialno;
+  std::vector<int64_t> granulepos;
+  std::vector<uint8_t> flags;
+  std::vector<uint8_t> crc;
+};
+
+}  // namespace nodeogg
+
+#endif
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2020, Valyant AI
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "slab.hxx"
+
+#include <stdlib.h>
+
+namespace nodeogg {
+
+Slab::Slab(size_t size)
+    : data(static_cast<unsigned char *>(malloc(size))),
+      size(data ? size : 0),
+      used(0),
+      refs(1) {}
+
+Slab::~Slab() { free(data); }
+
+Napi::ArrayBuffer Slab::Value(Napi::Env env) {
+  if (ref.IsEmpty()) {
+    Napi::ArrayBuffer arrayBuffer =
+        Napi::ArrayBuffer::New(env, data, size, Finalize, this);
+    ref = Napi::Reference<Napi::ArrayBuffer>::New(arrayBuffer, 1);
+    refs++;
+  }
+  return ref.Value();
+}
+
+void Slab::Retire() {
+  if (!ref.IsEmpty()) ref.Unref();
+  Release();
+}
+
+void Slab::Release() {
+  if (--refs == 0) delete this;
+}
+
+void Slab::Finalize(Napi::Env, void *, Slab *slab) { slab->Release(); }
+
+SlabAllocator::~SlabAllocator() {
+  Collect();
+  if (current) current->Retire();
+}
+
+Slab *SlabAllocator::Allocate(size_t length, size_t *offset) {
+  if (length > kMaxSlice) return NULL;
+
+  if (current == NULL || current->used + length > current->size) {
+    if (current) retired.push_back(current);
+    current = new Slab(kSlabSize);
+    if (current->size < length) return NULL;
+  }
+
+  *offset = current->used;
+  current->used += length;
+  return current;
+}
+
+void SlabAllocator::Collect() {
+  for (size_t i = 0; i < retired.size(); i++) retired[i]->Retire();
+  retired.clear();
+}
+
+}  // namespace nodeogg
@@ -0,0 +1,64 @@
+#ifndef SLAB_HXX
+#define SLAB_HXX
+
+#include <napi.h>
+
+#include <vector>
+
+namespace nodeogg {
+
+/* A block of memory that many small packet payloads are packed into. It is
+ * handed to JS as a single external ArrayBuffer, and the packets are Buffer
+ * views into it, so there is one allocation and one finalizer per slab rather
+ * than per packet. The memory is freed once the allocator is done filling the
+ * slab and the ArrayBuffer, i.e. every packet in it, has been collected.
+ */
+class Slab {
+ public:
+  explicit Slab(size_t size);
+
+  // the ArrayBuffer wrapping this slab, created on first use; main thread only
+  Napi::ArrayBuffer Value(Napi::Env env);
+  // called by the allocator once it won't hand out any more of this slab
+  void Retire();
+
+  unsigned char *data;
+  size_t size;
+  size_t used;
+
+ private:
+  ~Slab();
+  void Release();
+  static void Finalize(Napi::Env env, void *data, Slab *slab);
+
+  int refs;
+  // strong until the slab is retired, so that a slab being filled is never
+  // wrapped by more than one ArrayBuffer
+  Napi::Reference<Napi::ArrayBuffer> ref;
+};
+
+class SlabAllocator {
+ public:
+  static const size_t kSlabSize = 64 * 1024;
+  static const size_t kMaxSlice = 8 * 1024;
+
+  SlabAllocator() : current(NULL) {}
+  ~SlabAllocator();
+
+  // Reserves `length` bytes and returns the slab they live in, or NULL when
+  // the payload is too large to be worth packing. Doesn't touch JS, so it can
+  // be used from the thread pool.
+  Slab *Allocate(size_t length, size_t *offset);
+
+  // Retires the slabs that `Allocate()` has moved past. Main thread only, and
+  // only once all of their slices have been turned into JS values.
+  void Collect();
+
+ private:
+  Slab *current;
+  std::vector<Slab *> retired;
+};
+
+}  // namespace nodeogg
+
+#endif
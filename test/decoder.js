@@ -3,12 +3,36 @@ var fs = require('fs');
 var path = require('path');
 var assert = require('assert');
 var Decoder = require('../').Decoder;
+var PacketBatch = require('../').PacketBatch;
+var scanPages = require('../').scanPages;
+var binding = require('../lib/binding');
 var fixtures = path.resolve(__dirname, 'fixtures');
 
 describe('Decoder', function () {
 
   describe('"320x240.ogv" fixture file', function () {
     var fixture = path.resolve(fixtures, '320x240.ogv');
+    var expected = { 1761486570: 3, 252396615: 134 };
+
+    // Pipes the fixture into a `new Decoder(opts)` and checks, once it
+    // finishes, the number of packets each stream emitted (counting every
+    // packet of a `PacketBatch`). `readOpts` go to the file's read stream.
+    // Returns the decoder, for more listeners.
+    function decodePackets(opts, readOpts, done) {
+      var decoder = new Decoder(opts);
+      var got = { 1761486570: 0, 252396615: 0 };
+      decoder.on('stream', function (stream) {
+        stream.on('packet', function (packet) {
+          got[stream.serialno] += packet instanceof PacketBatch ? packet.length : 1;
+        });
+      });
+      decoder.on('finish', function () {
+        assert.deepEqual(expected, got);
+        done();
+      });
+      fs.createReadStream(fixture, readOpts).pipe(decoder);
+      return decoder;
+    }
 
     it('should get 2 "stream" events', function (done) {
       var decoder = new Decoder();
@@ -82,20 +106,212 @@ describe('Decoder', function () {
     });
 
     it('should get the expected number of "packet" events for each stream', function (done) {
+      decodePackets({}, {}, done);
+    });
+
+    [ 0, Infinity ].forEach(function (asyncThreshold) {
+      it('should get the same "packet" events with asyncThreshold ' + asyncThreshold, function (done) {
+        decodePackets({ asyncThreshold: asyncThreshold }, {}, done);
+      });
+    });
+
+    [ 'sampled', 'deferred', 'off' ].forEach(function (verify) {
+      it('should get the same "packet" events with verify "' + verify + '"', function (done) {
+        var decoder = decodePackets({ verify: verify, verifyInterval: 4 }, {}, done);
+        decoder.on('corrupt', function () {
+          done(new Error('unexpected "corrupt" event'));
+        });
+      });
+    });
+
+    it('should get the same "packet" events with a `ring` sync buffer', function (done) {
+      var decoder = decodePackets({ ring: 4096 }, { highWaterMark: 1500 }, done);
+      // mapping the ring is only implemented on Linux, elsewhere it falls back
+      if (process.platform === 'linux') assert(decoder._decoder.ring);
+    });
+
+    it('should emit "corrupt" before "finish" with verify "deferred"', function (done) {
+      var data = fs.readFileSync(fixture);
+      var scan = scanPages(data);
+      data[scan.offsets[1] + 40] ^= 1;
+
+      var decoder = new Decoder({ verify: 'deferred' });
+      var corrupt = [];
+      decoder.on('corrupt', function (offset, length) {
+        corrupt.push([ offset, length ]);
+      });
+      decoder.on('finish', function () {
+        assert.deepEqual([ [ scan.offsets[1], scan.lengths[1] ] ], corrupt);
+        done();
+      });
+      decoder.end(data);
+    });
+
+    it('should verify what was written with verify "deferred" when the writer reuses its Buffer', function (done) {
+      var data = fs.readFileSync(fixture);
+      var chunk = Buffer.alloc(4096);
+      var decoder = new Decoder({ verify: 'deferred' });
+      decoder.on('corrupt', function () {
+        done(new Error('unexpected "corrupt" event'));
+      });
+      decoder.on('finish', done);
+
+      var offset = 0;
+      (function write() {
+        if (offset >= data.length) return decoder.end();
+        var n = data.copy(chunk, 0, offset);
+        offset += n;
+        // overwrites the previous chunk as soon as it has been written
+        decoder.write(chunk.subarray(0, n), write);
+      })();
+    });
+
+    it('should emit `PacketBatch`es with `batch`', function (done) {
+      var decoder = decodePackets({ batch: true }, {}, done);
+      decoder.on('stream', function (stream) {
+        stream.on('packet', function (batch) {
+          assert(batch instanceof PacketBatch);
+          assert.equal('bigint', typeof batch.granulepos[0]);
+        });
+      });
+    });
+
+    [ {}, { singleCopy: true } ].forEach(function (opts) {
+      it('should emit every "page" in input order to listeners added on "stream"' +
+         (opts.singleCopy ? ' with `singleCopy`' : ''), function (done) {
+        var data = fs.readFileSync(fixture);
+        var scan = scanPages(data);
+        var decoder = new Decoder(opts);
+        var events = [];
+        decoder.on('page', function (page) {
+          events.push('page ' + page.serialno);
+        });
+        decoder.on('stream', function (stream) {
+          events.push('stream ' + stream.serialno);
+          stream.on('page', function (page) {
+            assert.equal(stream.serialno, page.serialno);
+            events.push('stream page ' + page.serialno);
+          });
+          stream.resume();
+        });
+        decoder.on('finish', function () {
+          var expected = [];
+          var seen = {};
+          for (var i = 0; i < scan.serialno.length; i++) {
+            var serialno = scan.serialno[i];
+            expected.push('page ' + serialno);
+            if (!seen[serialno]) expected.push('stream ' + serialno);
+            seen[serialno] = true;
+            expected.push('stream page ' + serialno);
+          }
+          assert.deepEqual(expected, events);
+          done();
+        });
+        // a single chunk holding the whole file
+        decoder.end(data);
+      });
+    });
+
+    it('should emit the same packets with `singleCopy`', function (done) {
+      var copied = [];
+      var viewed = [];
+      collect({}, copied, function () {
+        collect({ singleCopy: true }, viewed, function () {
+          assert.equal(copied.length, viewed.length);
+          copied.forEach(function (a, i) {
+            var b = viewed[i];
+            assert.equal(a.serialno, b.serialno);
+            assert.equal(a.packetno, b.packetno);
+            assert.equal(a.granulepos, b.granulepos);
+            assert.equal(!!a.b_o_s, !!b.b_o_s);
+            assert.equal(!!a.e_o_s, !!b.e_o_s);
+            assert.deepEqual(a.packet, b.packet);
+          });
+          done();
+        });
+      });
+
+      function collect(opts, packets, fn) {
+        var decoder = new Decoder(opts);
+        decoder.on('stream', function (stream) {
+          stream.on('packet', function (packet) {
+            packets.push({
+              serialno: stream.serialno,
+              packet: Buffer.from(packet.packet),
+              b_o_s: packet.b_o_s,
+              e_o_s: packet.e_o_s,
+              granulepos: packet.granulepos,
+              packetno: packet.packetno
+            });
+          });
+        });
+        decoder.on('finish', fn);
+        fs.createReadStream(fixture).pipe(decoder);
+      }
+    });
+
+    it('should pack small packets into shared slabs', function (done) {
       var decoder = new Decoder();
-      var input = fs.createReadStream(fixture);
-      var expected = { 1761486570: 3, 252396615: 134 };
-      var got = { 1761486570: 0, 252396615: 0 };
+      var buffers = [];
       decoder.on('stream', function (stream) {
-        stream.on('packet', function () {
-          got[stream.serialno]++;
+        stream.on('packet', function (packet) {
+          if (packet.packet.length < 1024) buffers.push(packet.packet.buffer);
         });
       });
       decoder.on('finish', function () {
-        assert.deepEqual(expected, got);
+        assert(buffers.length > 1);
+        assert.equal(buffers[0], buffers[1]);
         done();
       });
-      input.pipe(decoder);
+      fs.createReadStream(fixture).pipe(decoder);
+    });
+
+    it('should hand out one group per stream for each chunk', function () {
+      var decoder = new binding.ogg_decoder();
+      var rtn = decoder.writeSync(fs.readFileSync(fixture), true);
+      assert.equal(null, rtn[0]);
+      var serialnos = rtn[1].map(function (group) { return group.serialno; });
+      assert.deepEqual([ 1761486570, 252396615 ].sort(), serialnos.sort());
+      rtn[1].forEach(function (group) {
+        assert(group.pages.length > 0);
+        group.packets.forEach(function (packet) {
+          assert.equal(group.serialno, packet.serialno);
+        });
+      });
+    });
+
+    it('should scan every page in place with `scanPages`', function () {
+      var data = fs.readFileSync(fixture);
+      var scan = scanPages(data, 0);
+      assert.equal(81, scan.offsets.length);
+      assert.equal(data.length, scan.next);
+      for (var i = 0; i < scan.offsets.length; i++) {
+        assert.equal(1, scan.crc[i]);
+        assert.equal('OggS', data.toString('latin1', scan.offsets[i], scan.offsets[i] + 4));
+        if (i > 0) assert.equal(scan.offsets[i - 1] + scan.lengths[i - 1], scan.offsets[i]);
+      }
+      assert.equal(2, scan.flags[0] & 2);
+
+      // a flipped bit shows up as a failed checksum, the truncated tail as `next`
+      var last = scan.offsets.length - 1;
+      data[scan.offsets[1] + 40] ^= 1;
+      var damaged = scanPages(data.slice(0, data.length - 1));
+      assert.equal(0, damaged.crc[1]);
+      assert.equal(scan.offsets[last], damaged.next);
+    });
+
+    it('should report an offset outside of the buffer as a RangeError', function (done) {
+      var data = Buffer.alloc(16);
+      assert.throws(function () {
+        scanPages(data, 17);
+      }, RangeError);
+      scanPages(data, -1, function (err) {
+        assert(err instanceof RangeError);
+        scanPages('OggS', 0, function (err) {
+          assert(err instanceof TypeError);
+          done();
+        });
+      });
     });
 
     it('should get 1 "end" event for each "stream"', function (done) {
@@ -76,6 +76,536 @@ describe('Encoder', function () {
       });
     });
 
+    it('should accept an Array of `ogg_packet` instances', function (done) {
+      var e = new Encoder();
+      // flow...
+      e.resume();
+
+      e.on('end', done);
+      var s = e.stream();
+      var packets = [ 'foo', 'bar' ].map(function (str, i) {
+        var packet = new ogg_packet();
+        packet.packet = Buffer.from(str);
+        packet.b_o_s = i === 0 ? 1 : 0;
+        packet.e_o_s = i === 1 ? 1 : 0;
+        packet.granulepos = i;
+        packet.packetno = i;
+        return packet;
+      });
+      s.packetin(packets, function (err) {
+        if (err) return done(err);
+        s.flush(function (err) {
+          if (err) return done(err);
+          // wait for "end" event...
+        });
+      });
+    });
+
+    it('should pass an Array of anything else to the callback as an error', function (done) {
+      var s = new Encoder().stream();
+      s.on('error', function () {});
+      s.packetin([ { packet: Buffer.from('foo') } ], function (err) {
+        assert(err instanceof TypeError);
+        done();
+      });
+    });
+
+  });
+
+  describe('with a `PacketBatch`', function () {
+
+    it('should emit an "end" event after the batch\'s "e_o_s" packet', function (done) {
+      var e = new Encoder();
+      // flow...
+      e.resume();
+
+      e.on('end', done);
+      var s = e.stream();
+      var batch = ogg.PacketBatch.from([
+        { packet: Buffer.from('foo'), b_o_s: 1, granulepos: 0, packetno: 0 },
+        { packet: Buffer.from('bar'), e_o_s: 1, granulepos: 1, packetno: 1 }
+      ]);
+      s.packetin(batch, function (err) {
+        if (err) return done(err);
+        s.flush(function (err) {
+          if (err) return done(err);
+          // wait for "end" event...
+        });
+      });
+    });
+
+    it('should grow the stream buffers geometrically', function (done) {
+      var e = new Encoder();
+      e.resume();
+      var s = e.stream();
+      var packets = [];
+      for (var i = 0; i < 256; i++) {
+        packets.push({ packet: Buffer.alloc(4096), b_o_s: i === 0 ? 1 : 0, packetno: i });
+      }
+      s.packetin(ogg.PacketBatch.from(packets), function (err) {
+        if (err) return done(err);
+        assert(s.os.reallocs <= 10, s.os.reallocs + ' reallocs');
+        done();
+      });
+    });
+
+    it('should count only the selected packets\' bytes after .select()', function () {
+      var batch = ogg.PacketBatch.from([
+        { packet: Buffer.alloc(10) },
+        { packet: Buffer.alloc(300) },
+        { packet: Buffer.alloc(20) }
+      ]);
+      batch.serialno = Int32Array.from([ 1, 2, 1 ]);
+      assert.equal(330, batch.bytes);
+      assert.equal(30, batch.select(1).bytes);
+      assert.equal(300, batch.select(2).bytes);
+    });
+
+  });
+
+  describe('with .readInto()', function () {
+
+    it('should copy the pages into the given buffer', function (done) {
+      var e = new Encoder();
+      var s = e.stream(1234);
+      var packets = [
+        { packet: Buffer.alloc(100, 1), b_o_s: 1, granulepos: 0, packetno: 0 },
+        { packet: Buffer.alloc(100, 2), e_o_s: 1, granulepos: 1, packetno: 1 }
+      ];
+      s.mux(ogg.PacketBatch.from(packets), true, function (err) {
+        if (err) return done(err);
+        var arena = Buffer.alloc(1024);
+        var n = e.readInto(arena, 16);
+        assert(n > 200);
+        assert.equal('OggS', arena.toString('ascii', 16, 20));
+        assert.equal(0, e.readInto(arena, 16 + n));
+        done();
+      });
+    });
+
+  });
+
+  describe('with packets in pieces', function () {
+
+    it('should page them out as if they had been concatenated', function (done) {
+      var e = new Encoder();
+      var s = e.stream(1234);
+      var pages = [];
+      s.on('page', function (stream, og) {
+        pages.push(Buffer.concat([ og.header, og.body ]));
+      });
+      var head = [ Buffer.from('OpusHead'), Buffer.from([ 1, 2, 0, 0x0f ]) ];
+      var frames = [
+        { packet: [ Buffer.alloc(300, 1), Buffer.alloc(20, 2) ], granulepos: 960 },
+        { packet: [ Buffer.alloc(10, 3) ], e_o_s: 1, granulepos: 1920 }
+      ];
+      s.packetin({ packet: head, granulepos: 0, flush: true }, function (err) {
+        if (err) return done(err);
+        s.packetin(frames, function (err) {
+          if (err) return done(err);
+          s.flush(function (err) {
+            if (err) return done(err);
+            assert.equal(2, pages.length);
+            var first = pages[0].slice(pages[0].length - 12);
+            assert(first.equals(Buffer.concat(head)));
+            var second = pages[1].slice(pages[1].length - 330);
+            assert(second.equals(Buffer.concat(frames[0].packet.concat(frames[1].packet))));
+            done();
+          });
+        });
+      });
+    });
+
+    it('should take a BigInt granulepos in either form', function (done) {
+      var e = new Encoder();
+      var s = e.stream(1234);
+      var positions = [];
+      s.on('page', function (stream, og) {
+        positions.push(og.header.readBigInt64LE(6));
+      });
+      s.packetin({ packet: [ Buffer.from('OpusHead') ], granulepos: 960n, flush: true }, function (err) {
+        if (err) return done(err);
+        s.packetin([ { packet: [ Buffer.alloc(10) ], e_o_s: 1, granulepos: 4294967296n } ], function (err) {
+          if (err) return done(err);
+          s.flush(function (err) {
+            if (err) return done(err);
+            assert.deepEqual([ 960n, 4294967296n ], positions);
+            done();
+          });
+        });
+      });
+    });
+
+  });
+
+  describe('with .mux()', function () {
+
+    it('should emit a single "pages" event per call', function (done) {
+      var e = new Encoder();
+      // flow...
+      e.resume();
+
+      var s = e.stream();
+      var events = 0;
+      s.on('pages', function (stream, data, lengths, granulepos, e_o_s) {
+        events++;
+        assert.equal(1, lengths.length);
+        assert.equal(data.length, lengths[0]);
+        assert.equal('OggS', data.toString('ascii', 0, 4));
+        assert.equal(1n, granulepos[0]);
+        assert(e_o_s);
+      });
+      e.on('end', function () {
+        assert.equal(1, events);
+        done();
+      });
+      var packets = [ 'foo', 'bar' ].map(function (str, i) {
+        var data = Buffer.from(str);
+        var packet = new ogg_packet();
+        packet.packet = data;
+        packet.bytes = data.length;
+        packet.b_o_s = i === 0 ? 1 : 0;
+        packet.e_o_s = i === 1 ? 1 : 0;
+        packet.granulepos = i;
+        packet.packetno = i;
+        return packet;
+      });
+      s.mux(packets, true, function (err) {
+        if (err) return done(err);
+        // wait for "end" event...
+      });
+    });
+
+    it('should emit the same pages with `zeroCopy`', function (done) {
+      function encode(zeroCopy, fn) {
+        var e = new Encoder();
+        var s = e.stream(1234, { zeroCopy: zeroCopy });
+        var pages = [];
+        s.on('pages', function (stream, data) {
+          pages.push(Buffer.from(data));
+        });
+        var packets = [];
+        for (var i = 0; i < 40; i++) {
+          packets.push({ packet: Buffer.alloc(100 * i, i), b_o_s: i === 0 ? 1 : 0, e_o_s: i === 39 ? 1 : 0, granulepos: i, packetno: i });
+        }
+        // the first call leaves packets behind for the second one
+        s.mux(ogg.PacketBatch.from(packets.slice(0, 25)), function (err) {
+          if (err) return fn(err);
+          s.mux(ogg.PacketBatch.from(packets.slice(25)), true, function (err) {
+            fn(err, Buffer.concat(pages));
+          });
+        });
+      }
+      encode(false, function (err, copied) {
+        if (err) return done(err);
+        encode(true, function (err, referenced) {
+          if (err) return done(err);
+          assert(copied.length > 0);
+          assert(copied.equals(referenced));
+          done();
+        });
+      });
+    });
+
+    it('should reject entries that aren\'t `ogg_packet` instances', function () {
+      var binding = require('../lib/binding');
+      var s = new Encoder().stream();
+      var packets = [ { packet: Buffer.from('foo'), bytes: 3, b_o_s: 1 } ];
+      assert.throws(function () {
+        binding.ogg_stream_muxSync(s.os, packets, true, false);
+      }, TypeError);
+      assert.throws(function () {
+        binding.ogg_stream_mux(s.os, packets, true, false, undefined, function () {});
+      }, TypeError);
+    });
+
+    it('should keep the payloads alive when the Array is cleared', function (done) {
+      var binding = require('../lib/binding');
+      function packets() {
+        var list = [];
+        for (var i = 0; i < 20; i++) {
+          var packet = new ogg_packet();
+          packet.packet = Buffer.alloc(1000, i);
+          packet.b_o_s = i === 0 ? 1 : 0;
+          packet.e_o_s = i === 19 ? 1 : 0;
+          packet.granulepos = i;
+          packet.packetno = i;
+          list.push(packet);
+        }
+        return list;
+      }
+      var expected = binding.ogg_stream_muxSync(new Encoder().stream(1234).os, packets(), true, false)[1];
+
+      var pending = 2;
+      [ false, true ].forEach(function (zeroCopy) {
+        var list = packets();
+        binding.ogg_stream_mux(new Encoder().stream(1234).os, list, true, zeroCopy, undefined, function (rtn, data) {
+          assert.equal(0, rtn);
+          assert(expected.equals(data));
+          if (--pending === 0) done();
+        });
+        list.forEach(function (packet) {
+          packet.packet = Buffer.alloc(0);
+        });
+        list.length = 0;
+        if (global.gc) global.gc();
+      });
+    });
+
+  });
+
+  describe('with `pageBytes` and `pageDuration`', function () {
+
+    function packets(n, size) {
+      var list = [];
+      for (var i = 0; i < n; i++) {
+        list.push({ packet: Buffer.alloc(size, i), b_o_s: i === 0 ? 1 : 0, e_o_s: i === n - 1 ? 1 : 0, granulepos: i * 960, packetno: i });
+      }
+      return list;
+    }
+
+    it('should make smaller pages with a smaller `pageBytes`', function (done) {
+      function count(pageBytes, fn) {
+        var e = new Encoder();
+        var s = e.stream(1234, { pageBytes: pageBytes });
+        var n = 0;
+        s.on('pages', function (stream, data, lengths) {
+          n += lengths.length;
+        });
+        s.mux(ogg.PacketBatch.from(packets(40, 500)), true, function (err) {
+          fn(err, n);
+        });
+      }
+      count(null, function (err, large) {
+        if (err) return done(err);
+        count(1500, function (err, small) {
+          if (err) return done(err);
+          assert(small > large);
+          done();
+        });
+      });
+    });
+
+    it('should flush pages that would span more than `pageDuration`', function (done) {
+      var e = new Encoder();
+      var s = e.stream(1234, { pageDuration: 960 * 3 });
+      var positions = [];
+      s.on('pages', function (stream, data, lengths, granulepos) {
+        for (var i = 0; i < granulepos.length; i++) positions.push(Number(granulepos[i]));
+      });
+      var list = packets(20, 10);
+      (function next(i) {
+        if (i === list.length) {
+          assert(positions.length > 5);
+          for (var j = 1; j < positions.length; j++) {
+            assert(positions[j] - positions[j - 1] <= 960 * 3);
+          }
+          return done();
+        }
+        s.mux(ogg.PacketBatch.from([ list[i] ]), function (err) {
+          if (err) return done(err);
+          next(i + 1);
+        });
+      })(0);
+    });
+
+  });
+
+  describe('with `flushDeadline`', function () {
+
+    it('should flush a quiet stream\'s partial page', function (done) {
+      var e = new Encoder({ flushDeadline: 20 });
+      var s = e.stream(1234);
+      var pages = 0;
+      e.on('data', function () {
+        // the "bos" page, then the flushed one
+        if (++pages === 2) done();
+      });
+      s.mux(ogg.PacketBatch.from([ { packet: Buffer.alloc(10), b_o_s: 1 } ]), function (err) {
+        if (err) return done(err);
+        s.mux(ogg.PacketBatch.from([ { packet: Buffer.alloc(10), granulepos: 960, packetno: 1 } ]), function (err) {
+          if (err) return done(err);
+          // not enough for a page without the deadline
+        });
+      });
+    });
+
+    it('should flush a packet left behind by a mux that paged out', function (done) {
+      var e = new Encoder({ flushDeadline: 20 });
+      var s = e.stream(1234, { pageBytes: 100 });
+      var pages = 0;
+      e.on('data', function () {
+        // the "bos" page, the page of four packets, then the flushed one
+        if (++pages === 3) done();
+      });
+      var packets = [];
+      for (var i = 1; i <= 4; i++) {
+        packets.push({ packet: Buffer.alloc(100), granulepos: 960 * i, packetno: i });
+      }
+      // smaller than the header of the page that comes out before it
+      packets.push({ packet: Buffer.alloc(5), granulepos: 960 * 5, packetno: 5 });
+      s.mux(ogg.PacketBatch.from([ { packet: Buffer.alloc(10), b_o_s: 1 } ]), function (err) {
+        if (err) return done(err);
+        s.mux(ogg.PacketBatch.from(packets), function (err) {
+          if (err) return done(err);
+        });
+      });
+    });
+
+  });
+
+  describe('with an `OpusEncoder`', function () {
+
+    // TOC bytes: SILK 20 ms and 60 ms, one frame each
+    var frame20 = Buffer.alloc(60, 0x08);
+    var frame60 = Buffer.alloc(60, 0x18);
+
+    function encode(opts, fn, frames) {
+      var e = new Encoder();
+      var opus = new ogg.OpusEncoder(48000, 1, 960, opts);
+      var chunks = [];
+      e.on('data', function (chunk) { chunks.push(chunk); });
+      e.on('end', function () {
+        fn(ogg.scanPages(Buffer.concat(chunks)));
+      });
+      e.use(opus);
+      frames = frames || Array(50).fill(frame20);
+      for (var i = 0; i < frames.length; i++) opus.write(frames[i]);
+      opus.end();
+    }
+
+    it('should flush every packet onto a page of its own by default', function (done) {
+      encode(undefined, function (scan) {
+        assert.equal(2 + 50, scan.offsets.length);
+        done();
+      });
+    });
+
+    it('should read out `ogg_packet` instances, headers included', function (done) {
+      var opus = new ogg.OpusEncoder(48000, 1, 960);
+      var packets = [];
+      opus.on('data', function (packet) { packets.push(packet); });
+      opus.on('end', function () {
+        assert.equal(2 + 2, packets.length);
+        packets.forEach(function (packet) {
+          assert(packet instanceof ogg_packet);
+        });
+        assert.equal('OpusHead', packets[0].packet.toString('ascii', 0, 8));
+        assert.equal('OpusTags', packets[1].packet.toString('ascii', 0, 8));
+        done();
+      });
+      opus.write(frame20);
+      opus.end(frame20);
+    });
+
+    it('should aggregate packets with `pageDuration`', function (done) {
+      encode({ pageDuration: 200 }, function (scan) {
+        // two header pages, then a page per 200 ms of 20 ms frames or so
+        var pages = scan.offsets.length;
+        assert(pages >= 2 + 5);
+        assert(pages <= 2 + 10);
+        done();
+      });
+    });
+
+    it('should end the stream with an empty page with `zeroDelay`', function (done) {
+      var e = new Encoder();
+      var opus = new ogg.OpusEncoder(48000, 1, 960, { zeroDelay: true });
+      var chunks = [];
+      e.on('data', function (chunk) {
+        // the packet is out before the stream ends
+        if (chunks.push(chunk) === 3) opus.end();
+      });
+      e.on('end', function () {
+        var scan = ogg.scanPages(Buffer.concat(chunks));
+        var last = scan.offsets.length - 1;
+        assert.equal(2 + 1 + 1, scan.offsets.length);
+        assert.equal(4, scan.flags[last] & 4);
+        assert.equal(27, scan.lengths[last]);
+        assert.equal(960, Number(scan.granulepos[last]));
+        done();
+      });
+      e.use(opus);
+      opus.write(frame20);
+    });
+
+    it('should advance granulepos by each packet\'s TOC duration', function (done) {
+      var frames = [ frame20, frame60, frame20, frame60 ];
+      assert.deepEqual([ 960, 2880, 960, 2880 ], Array.from(ogg.opusDurations(frames)));
+      encode(undefined, function (scan) {
+        var last = scan.granulepos[scan.granulepos.length - 1];
+        assert.equal(960 + 2880 + 960 + 2880, Number(last));
+        done();
+      }, frames);
+    });
+
+    it('should read CELT, hybrid and multi-frame TOCs with `opusDurations()`', function () {
+      var packets = [
+        Buffer.from([ 0x80 ]),        // CELT 2.5 ms, code 0
+        Buffer.from([ 0x69 ]),        // hybrid 20 ms, code 1: two frames
+        Buffer.from([ 0x0b, 0x03 ]),  // SILK 20 ms, code 3: three frames
+        Buffer.from([ 0x83, 48 ])     // CELT 2.5 ms, code 3: 120 ms in all
+      ];
+      assert.deepEqual([ 120, 1920, 3 * 960, 5760 ], Array.from(ogg.opusDurations(packets)));
+    });
+
+    it('should return -1 for invalid packets with `opusDurations()`', function () {
+      var packets = [
+        Buffer.from([ 0x0b, 0x00 ]),  // code 3 with a frame count of 0
+        Buffer.from([ 0x0b ]),        // code 3 without its count byte
+        Buffer.from([ 0x83, 49 ])     // 49 frames of 2.5 ms, over 120 ms
+      ];
+      assert.deepEqual([ -1, -1, -1 ], Array.from(ogg.opusDurations(packets)));
+    });
+
+  });
+
+  describe('with `interleave`', function () {
+
+    it('should write pages in granulepos order across streams', function (done) {
+      var e = new Encoder({ interleave: true, maxInterleaveDelay: 100 });
+      var a = e.stream(1, { granuleRate: 1 });
+      var b = e.stream(2, { granuleRate: 1 });
+      var chunks = [];
+      e.on('data', function (chunk) {
+        chunks.push(chunk);
+      });
+      e.on('end', function () {
+        var data = Buffer.concat(chunks);
+        var order = [];
+        for (var offset = 0; offset < data.length;) {
+          var segments = data[offset + 26];
+          var length = 27 + segments;
+          for (var i = 0; i < segments; i++) length += data[offset + 27 + i];
+          order.push(data.readInt32LE(offset + 14) + ':' +
+            data.readBigInt64LE(offset + 6));
+          offset += length;
+        }
+        assert.deepEqual([ '1:0', '2:0', '2:5', '1:10', '2:15', '1:20' ], order);
+        done();
+      });
+
+      mux(a, [ 0, 10, 20 ], function () {
+        mux(b, [ 0, 5, 15 ], function () {});
+      });
+
+      function mux(s, granules, fn) {
+        var i = 0;
+        (function next(err) {
+          if (err) return done(err);
+          if (i === granules.length) return fn();
+          var packet = new ogg_packet();
+          packet.packet = Buffer.from('packet');
+          packet.bytes = 6;
+          packet.b_o_s = i === 0 ? 1 : 0;
+          packet.e_o_s = i === granules.length - 1 ? 1 : 0;
+          packet.granulepos = granules[i];
+          packet.packetno = i++;
+          s.mux([ packet ], true, next);
+        })();
+      }
+    });
+
   });
 
   describe('with three .stream()s', function () {